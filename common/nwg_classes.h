@@ -12,6 +12,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <variant>
@@ -131,11 +132,14 @@ struct Geometry {
 
 struct DesktopEntry {
     std::string name;
+    std::string generic_name;
+    std::string keywords;     // ';'-separated
     std::string exec;
+    std::string try_exec;     // program which must exist for the entry to be shown
     std::string icon;
     std::string comment;
-    std::string mime_type;
-    std::vector<std::string> categories;
+    std::uint64_t categories{ 0 }; // bitmask of known category ids
+    std::vector<std::uint32_t> actions; // file offsets of [Desktop Action] sections, parsed on demand
     bool terminal;
 };
 
@@ -110,7 +110,7 @@ int main(int argc, char *argv[]) {
             config.icon_size
         };
 
-        // This will be read-only, to find n most clicked items (n = number of grid columns)
+        // This will be read-only, sorted by frecency; n best are favourites (n = number of grid columns)
         std::vector<CacheEntry> favourites;
         if (config.favs) {
             try {
@@ -120,8 +120,7 @@ int main(int argc, char *argv[]) {
                 } else {
                     Log::info("No cache entries loaded");
                 }
-                auto n = std::min(config.num_col, cache.size());
-                favourites = get_favourites(std::move(cache), n);
+                favourites = get_favourites(std::move(cache));
             }  catch (...) {
                 // TODO: only save cache if favs were changed
                 Log::error("Failed to read cache file '", config.cached_file, "'");
@@ -138,6 +137,9 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        // looked up for every loaded entry
+        auto stats_index = index_stats(pinned, favourites, config.favs ? config.num_col : 0);
+
         std::vector<fs::path> dirs;
         if (!config.special_dirs.empty()) {
             using namespace std::string_view_literals;
@@ -164,7 +166,7 @@ int main(int argc, char *argv[]) {
 
         ntime::Time window_time{ "window", commons };
 
-        EntriesModel   table{ config, window, icon_provider, pinned, favourites };
+        EntriesModel   table{ config, window, icon_provider, stats_index };
         EntriesManager entries_provider{ dirs, table, config };
 
         ntime::Time model_time{ "models", window_time };
@@ -7,6 +7,9 @@
  * */
 #pragma once
 
+#include <cstring>
+#include <limits>
+#include <list>
 #include <unordered_set>
 
 #include <gtkmm.h>
@@ -17,6 +20,11 @@
 #include "nwgconfig.h"
 #include "filesystem-compat.h"
 #include "nwg_classes.h"
+#include "nwg_tools.h"
+#include "log.h"
+#include "grid_search.h"
+#include "grid_heap.h"
+#include "grid_slots.h"
 
 namespace ns = nlohmann;
 
@@ -48,6 +56,9 @@ struct Stats {
     int    position{ 0 };
     FavTag favorite{ Common };
     PinTag pinned{ Unpinned };
+    // frecency (time-decayed clicks) as a time-independent rank, see frecency_rank
+    double       rank{ -std::numeric_limits<double>::infinity() };
+    std::int64_t last_launch{ 0 }; // unix time
     Stats(int c, int i, FavTag f, PinTag p)
       : clicks(c), position(i), favorite(f), pinned(p) { }
     Stats() = default;
@@ -62,23 +73,36 @@ struct Entry {
 
     // TODO: should we store it separately?
     std::unique_ptr<DesktopEntry> desktop_entry_;
+    // name transformed so that byte comparison follows the locale's collation rules
+    std::string      collation_key;
+    // entries of parsed [Desktop Action] sections, see EntriesManager::load_actions_;
+    // they get boxes only once they match a search, see EntriesModel::box_matching_actions
+    std::list<Entry> actions;
+    // storage of desktop_id for actions: "<desktop id of the app>#<action id>"; empty for apps
+    std::string      action_id;
 
     Entry(std::string_view id, Stats stats, std::unique_ptr<DesktopEntry> entry):
         desktop_id{ id }, exec{ &entry->exec }, stats{ stats }, desktop_entry_{ std::move(entry) }
     {
-        // intentionally left blank
+        auto* key = g_utf8_collate_key(desktop_entry_->name.data(), desktop_entry_->name.size());
+        collation_key = key;
+        g_free(key);
     }
     auto & desktop_entry() {
         return *desktop_entry_;
     }
+    bool is_action() const {
+        return !action_id.empty();
+    }
 };
 
 class GridWindow;
+class AbstractBoxes;
 
 class GridBox : public Gtk::Button {
 public:
-    /* name, comment, desktop-id, index */
-    GridBox(Glib::ustring, Glib::ustring, Entry& entry);
+    /* name, entry */
+    GridBox(Glib::ustring, Entry& entry);
     GridBox(GridBox&&) = default;
     ~GridBox() = default;
 
@@ -90,12 +114,29 @@ public:
     void on_activate() override;
 
     Glib::ustring    name;
-    Glib::ustring    comment;
 
     Entry* entry;
+
+    // model showing the box, and the box's position in it, valid only if below model->indexed
+    const AbstractBoxes* model{ nullptr };
+    std::size_t          model_index{ 0 };
+};
+
+/* Orders boxes by frecency rank, see Stats::rank */
+struct RankLess {
+    bool operator()(const GridBox* a, const GridBox* b) const {
+        return a->entry->stats.rank < b->entry->stats.rank;
+    }
+};
+struct RankGreater {
+    bool operator()(const GridBox* a, const GridBox* b) const {
+        return a->entry->stats.rank > b->entry->stats.rank;
+    }
 };
 
 struct GridConfig: public Config {
+    static constexpr std::size_t MAX_CATEGORIES = 64; // bits in DesktopEntry::categories
+
     GridConfig(const InputParser& parser, const Glib::RefPtr<Gdk::Screen>& screen, const fs::path& config_dir);
 
     bool pins;                // whether to display pinned
@@ -106,50 +147,57 @@ struct GridConfig: public Config {
     std::size_t num_col{ 6 }; // number of grid columns
     fs::path pinned_file;     // file with pins
     fs::path cached_file;     // file with favs
+    fs::path index_file;      // file with parsed .desktop entries
     int icon_size{ 72 };
     RGBA background_color;
     bool oneshot{ false };    // run in foreground, exit when window is closed
     bool categories{ false }; // enable categories
+    bool strip_diacritics{ false }; // ignore diacritics when searching
     ns::json config_source;
+    // known categories, indexed by category id, i.e. by bit in DesktopEntry::categories
+    std::vector<std::string> category_names;
+    std::vector<std::string> category_labels; // localized
 };
 
 
 struct CategoryButton;
 
+/* Category buttons & filter state, indexed by category id (see GridConfig::category_names) */
 struct CategoriesSet {
+    using Id   = std::size_t;
+    using Mask = decltype(DesktopEntry::categories);
+
     struct Category {
-        std::string category;
-        std::size_t refs;
-        CategoryButton* button;
-        Category(std::string_view category): category{ category }, refs{ 1 } {}
+        std::size_t     refs{ 0 }; // number of boxes in the category
+        CategoryButton* button{ nullptr };
     };
 
-    std::list<Category> categories_store;
-    std::unordered_map<std::string_view, decltype(categories_store)::iterator> categories;
-    std::unordered_set<std::string_view> active_categories;
+    std::vector<Category> categories;
+    Mask active_categories{ 0 };
     bool all_enabled{ true };
 
-    using Index = typename decltype(categories_store)::iterator;
-
     CategoriesSet() = default;
-    bool toggle(std::string_view category);
-    std::pair<Index, bool> ref(std::string_view category);
-    std::pair<Index, bool> unref(std::string_view category);
-    bool enabled(std::string_view category) const;
-    bool enabled(const GridBox& box) const;
+    bool toggle(Id id);
+    // returns true if the category was just inserted
+    bool ref(Id id);
+    // returns true if the category was just deleted
+    bool unref(Id id);
+    bool enabled(Mask categories) const;
 
-    void delete_by_index(Index index);
+    // calls foo(id) for each category id set in `mask`
+    template <typename F>
+    static void for_each(Mask mask, F && foo) {
+        for (; mask; mask &= mask - 1) {
+            foo(Id(__builtin_ctzll(mask)));
+        }
+    }
 };
 
 struct CategoryButton: public Gtk::ToggleButton {
     Gdk::ModifierType modifiers;
     bool mod_pressed{ false };
 
-    CategoriesSet& categories;
-    CategoriesSet::Index index;
-
-    CategoryButton(const std::string& name, CategoriesSet& set, CategoriesSet::Index index);
-    ~CategoryButton();
+    CategoryButton(const std::string& name);
 
     bool on_button_press_event(GdkEventButton* key) override {
         mod_pressed = (key->state & modifiers) == Gdk::CONTROL_MASK;
@@ -177,7 +225,21 @@ struct CategoryButton: public Gtk::ToggleButton {
 class AbstractBoxes {
 protected:
     std::vector<GridBox*> boxes;
+    // boxes[0..indexed) know their positions (GridBox::model_index),
+    // positions of the rest are only updated once looked up
+    mutable std::size_t   indexed{ 0 };
+
+    // positions of boxes[from..] changed
+    void reindex_(std::size_t from) {
+        indexed = std::min(indexed, from);
+    }
+    void push_back_(GridBox& box) {
+        box.model = this;
+        boxes.push_back(&box);
+    }
 public:
+    static constexpr auto npos = std::size_t(-1);
+
     virtual ~AbstractBoxes() = default;
 
     decltype(auto) begin() { return boxes.begin(); }
@@ -185,6 +247,19 @@ public:
     auto & front() { return boxes.front(); }
     auto size() const { return boxes.size(); }
     auto empty() const { return boxes.empty(); }
+    // returns position of `box` or npos; O(1) unless boxes were moved since the last lookup
+    std::size_t position(const GridBox& box) const {
+        if (box.model != this) {
+            return npos;
+        }
+        if (box.model_index < indexed && boxes[box.model_index] == &box) {
+            return box.model_index;
+        }
+        for (; indexed < boxes.size(); ++indexed) {
+            boxes[indexed]->model_index = indexed;
+        }
+        return box.model_index;
+    }
 
     virtual void add(GridBox& box) = 0;
     virtual void erase(GridBox& box) = 0;
@@ -193,26 +268,162 @@ public:
 class BoxesModel: public AbstractBoxes, public Gio::ListModel, public Glib::Object {
 public:
     virtual ~BoxesModel() = default;
+    /* Bulk loading: boxes added after begin_bulk() are neither sorted nor announced
+     * until end_bulk(), which sorts them at once and merges them into already shown boxes,
+     * emitting one items_changed per run of adjacent new boxes
+     * (i.e. exactly one if the model was empty) */
+    void begin_bulk() {
+        bulk = true;
+        bulk_from = boxes.size();
+    }
+    virtual void end_bulk() {
+        bulk = false;
+        auto first_new = boxes.begin() + bulk_from;
+        if (first_new == boxes.end()) {
+            return;
+        }
+        auto less = [this](auto* a, auto* b) { return less_(*a, *b); };
+        if (bulk_from == 0) {
+            std::stable_sort(boxes.begin(), boxes.end(), less);
+            reindex_(0);
+            items_changed(0, 0, boxes.size());
+            return;
+        }
+        std::unordered_set<GridBox*> added{ first_new, boxes.end() };
+        std::stable_sort(first_new, boxes.end(), less);
+        std::inplace_merge(boxes.begin(), first_new, boxes.end(), less);
+        reindex_(0);
+        // positions are announced in ascending order, so boxes before each run are already in place
+        for (std::size_t i = 0; i < boxes.size();) {
+            if (!added.count(boxes[i])) {
+                ++i;
+                continue;
+            }
+            auto run_from = i;
+            while (i < boxes.size() && added.count(boxes[i])) {
+                ++i;
+            }
+            items_changed(run_from, 0, i - run_from);
+        }
+    }
     virtual void erase(GridBox& box) override {
-        if (auto iter = std::find(boxes.begin(), boxes.end(), &box); iter != boxes.end()) {
-            auto pos = std::distance(boxes.begin(), iter);
-            boxes.erase(iter);
+        if (auto pos = position(box); pos != npos) {
+            boxes.erase(boxes.begin() + pos);
+            box.model = nullptr;
+            reindex_(pos);
+            if (bulk) {
+                if (pos >= bulk_from) {
+                    // was not announced yet
+                    return;
+                }
+                --bulk_from;
+            }
             box.reference();
             items_changed(pos, 1, 0);
         }
     }
     virtual void update(GridBox& from, GridBox& to) {
-        if (auto iter = std::find(boxes.begin(), boxes.end(), &from); iter != boxes.end()) {
-            auto pos = std::distance(boxes.begin(), iter);
+        if (auto pos = position(from); pos != npos) {
             // two references required, but why?
             to.reference();
             to.reference();
-            *iter = &to;
-            items_changed(pos, 1, 1);
+            boxes[pos] = &to;
+            from.model = nullptr;
+            to.model = this;
+            to.model_index = pos;
+            if (!bulk || pos < bulk_from) {
+                items_changed(pos, 1, 1);
+            }
         }
     }
 protected:
+    bool        bulk{ false };
+    std::size_t bulk_from{ 0 };
+
     BoxesModel(): Glib::ObjectBase(typeid(BoxesModel)), Gio::ListModel() {}
+    // order in which `add` keeps boxes
+    virtual bool less_(const GridBox& a, const GridBox& b) const = 0;
+    /* Replaces boxes with `next`, announcing an edit script instead of the whole model:
+     * of the boxes kept from the old sequence, the longest run keeping its relative order stays,
+     * the rest are moved, i.e. removed and inserted again. All removals are announced first,
+     * from the last position down, so that a moved box is unparented before it is inserted;
+     * then insertions follow in ascending order, so boxes before each run are already in place.
+     * Removed boxes are referenced once, inserted ones `added_refs` times. */
+    void assign_(std::vector<GridBox*>&& next, unsigned added_refs) {
+        auto old = std::move(boxes);
+        boxes = std::move(next);
+        indexed = 0;
+        std::unordered_map<GridBox*, std::size_t> old_positions;
+        old_positions.reserve(old.size());
+        for (std::size_t i = 0; i < old.size(); ++i) {
+            old_positions.emplace(old[i], i);
+        }
+        // old positions of the kept boxes, in the new order
+        std::vector<std::size_t> kept;
+        for (auto* box: boxes) {
+            if (auto iter = old_positions.find(box); iter != old_positions.end()) {
+                kept.push_back(iter->second);
+            }
+        }
+        // longest increasing subsequence of `kept`: tails[k] is the index in `kept`
+        // of the least tail of the subsequences of length k + 1, `prev` links them back
+        std::vector<std::size_t> tails, prev(kept.size());
+        for (std::size_t i = 0; i < kept.size(); ++i) {
+            auto iter = std::lower_bound(tails.begin(), tails.end(), kept[i], [&kept](auto t, auto pos) {
+                return kept[t] < pos;
+            });
+            prev[i] = iter == tails.begin() ? npos : *(iter - 1);
+            if (iter == tails.end()) {
+                tails.push_back(i);
+            } else {
+                *iter = i;
+            }
+        }
+        std::vector<bool> stays(old.size());
+        for (auto i = tails.empty() ? npos : tails.back(); i != npos; i = prev[i]) {
+            stays[kept[i]] = true;
+        }
+        for (std::size_t i = old.size(); i > 0;) {
+            if (stays[--i]) {
+                continue;
+            }
+            auto run_end = i + 1;
+            while (i > 0 && !stays[i - 1]) {
+                --i;
+            }
+            for (auto k = i; k < run_end; ++k) {
+                old[k]->reference();
+                old[k]->model = nullptr;
+            }
+            items_changed(i, run_end - i, 0);
+        }
+        for (std::size_t j = 0; j < boxes.size();) {
+            auto* box = boxes[j];
+            if (box->model == this) {
+                ++j;
+                continue;
+            }
+            auto run_from = j;
+            for (; j < boxes.size() && boxes[j]->model != this; ++j) {
+                boxes[j]->model = this;
+                for (unsigned k = 0; k < added_refs; ++k) {
+                    boxes[j]->reference();
+                }
+            }
+            items_changed(run_from, 0, j - run_from);
+        }
+    }
+    // inserts `box` before the first box not less than it, returns its position
+    std::size_t insert_sorted_(GridBox& box) {
+        auto iter = std::lower_bound(boxes.begin(), boxes.end(), &box, [this](auto* a, auto* b) {
+            return less_(*a, *b);
+        });
+        std::size_t pos = std::distance(boxes.begin(), iter);
+        boxes.insert(iter, &box);
+        box.model = this;
+        reindex_(pos);
+        return pos;
+    }
     GType get_item_type_vfunc() override {
         return GridBox::get_type();
     }
@@ -239,15 +450,6 @@ template <typename T> struct Create {
     }
 };
 
-inline auto container_add_sorted = [](auto && container, auto && elem, auto && cmp_less) {
-    auto iter = std::find_if(container.begin(), container.end(), [&](auto & other) {
-        return !cmp_less(elem, other);
-    });
-    auto pos = std::distance(container.begin(), iter);
-    container.insert(iter, elem);
-    return pos;
-};
-
 class PinnedBoxes: public BoxesModel, public Create<PinnedBoxes> {
     friend struct Create<PinnedBoxes>; // permit Create to access a protected constructor
 protected:
@@ -264,18 +466,23 @@ public:
             box.entry->stats.position = monotonic_index;
             ++monotonic_index;
         }
-        auto pos = container_add_sorted(boxes, &box, [](auto* a, auto* b) {
-            return a->entry->stats.position > b->entry->stats.position;
-        });
-
+        if (bulk) {
+            push_back_(box);
+            return;
+        }
         // monotonic index increases each time an entry is pinned
         // ensuring it will appear last
+        auto pos = insert_sorted_(box);
         items_changed(pos, 0, 1);
     }
     void erase(GridBox& box) override {
         box.entry->stats.position = 0;
         BoxesModel::erase(box);
     }
+protected:
+    bool less_(const GridBox& a, const GridBox& b) const override {
+        return a.entry->stats.position < b.entry->stats.position;
+    }
 };
 
 class FavBoxes: public BoxesModel, public Create<FavBoxes> {
@@ -285,67 +492,283 @@ protected:
 public:
     void add(GridBox& box) override {
         box.entry->stats.favorite = Stats::Favorite;
-        box.entry->stats.clicks = 1;
-        auto pos = container_add_sorted(boxes, &box, [](auto* a, auto* b) {
-            return a->entry->stats.clicks < b->entry->stats.clicks;
-        });
+        if (bulk) {
+            push_back_(box);
+            return;
+        }
+        auto pos = insert_sorted_(box);
         items_changed(pos, 0, 1);
     }
+protected:
+    bool less_(const GridBox& a, const GridBox& b) const override {
+        return a.entry->stats.rank > b.entry->stats.rank;
+    }
 };
 
 class AppBoxes: public BoxesModel, public Create<AppBoxes> {
     friend struct Create<AppBoxes>; // permit Create to access a protected constructor
 private:
-    std::vector<GridBox*> all_boxes; // unsorted & unfiltered boxes
-    Glib::ustring         search_criteria;
+    SearchTable           all_boxes; // unsorted & unfiltered boxes
+    SearchQuery           search_query;
     CategoriesSet&        categories;
-protected:
-    AppBoxes(CategoriesSet& set): Glib::ObjectBase(typeid(AppBoxes)), categories{ set } {}
-    void add_if_matches(GridBox* box) {
-        auto enabled = categories.enabled(*box);
-        if (enabled && (box->name.casefold().find(search_criteria) != Glib::ustring::npos)) {
-            container_add_sorted(boxes, box, [](auto* a, auto* b) {
-                return a->name.compare(b->name) > 0;
+    std::size_t           top_k; // number of best matches shown first
+    std::string_view      term;  // prefix of terminal apps' commands
+
+    /* Results of the previous queries, each narrowing the one below it:
+     * rows of all_boxes matching the query & enabled categories, in model order.
+     * Added rows are merged into them, other changes to all_boxes or enabled categories invalidate them. */
+    struct Narrowing {
+        std::string                query;
+        std::vector<std::uint32_t> rows;
+    };
+    std::vector<Narrowing> narrowing;
+    // results of recent queries, see invalidate_results
+    SearchCache   cache;
+    std::uint64_t generation{ 0 };
+    std::size_t   cache_lookups_logged{ 0 };
+    // boxes matching the query were added while filtered, but the view was not filtered again yet
+    bool          refilter_pending{ false };
+
+    // enabled categories, all bits set if all of them are enabled
+    CategoriesSet::Mask categories_mask_() const {
+        return categories.all_enabled ? ~CategoriesSet::Mask(0) : categories.active_categories;
+    }
+    // the same query gives different results for different enabled categories
+    std::string cache_key_(const std::string& query) const {
+        auto mask = categories_mask_();
+        auto key = query;
+        key.push_back('\0');
+        key.append(reinterpret_cast<const char*>(&mask), sizeof(mask));
+        return key;
+    }
+
+    // returns rows matching `query`, reusing the results of the previous queries if possible
+    const std::vector<std::uint32_t>& candidates_(const SearchQuery& query) {
+        // only results of a query contained in `query` can be narrowed further,
+        // results of too short queries lack matches in secondary fields,
+        // and results of the empty query lack actions
+        auto can_narrow = [&query](auto && previous) {
+            if (previous == query.text) {
+                return true;
+            }
+            return !previous.empty() && query.text.find(previous) != std::string::npos
+                && (previous.size() >= SearchTable::MIN_FIELDS_QUERY || query.text.size() < SearchTable::MIN_FIELDS_QUERY);
+        };
+        while (!narrowing.empty() && !can_narrow(narrowing.back().query)) {
+            narrowing.pop_back();
+        }
+        if (!narrowing.empty() && narrowing.back().query == query.text) {
+            return narrowing.back().rows;
+        }
+        auto key = cache_key_(query.text);
+        if (auto* cached = cache.get(key, generation)) {
+            return narrowing.emplace_back(Narrowing{ query.text, *cached }).rows;
+        }
+        auto && rows = all_boxes.rows;
+        Narrowing next{ query.text, {} };
+        if (narrowing.empty()) {
+            // names are short, so they are scanned; secondary fields are looked up in the index
+            for (std::uint32_t i = 0; i < rows.size(); ++i) {
+                if (shown_(rows[i], query) && SearchTable::matches_name(rows[i], query)) {
+                    next.rows.push_back(i);
+                }
+            }
+            for (auto i: all_boxes.lookup_fields(query)) {
+                if (shown_(rows[i], query) && !SearchTable::matches_name(rows[i], query)) {
+                    next.rows.push_back(i);
+                }
+            }
+            std::stable_sort(next.rows.begin(), next.rows.end(), [this,&rows](auto a, auto b) {
+                return less_(*rows[a].box, *rows[b].box);
             });
+        } else {
+            // filtering keeps the order
+            for (auto i: narrowing.back().rows) {
+                if (SearchTable::matches(rows[i], query)) {
+                    next.rows.push_back(i);
+                }
+            }
         }
+        cache.put(std::move(key), generation, next.rows);
+        return narrowing.emplace_back(std::move(next)).rows;
     }
-    void filter_impl(bool restore) {
-        // TODO: only update actually removed/inserted entries
-        auto old_size = boxes.size();
-        if (!restore) {
-            for (auto && box: boxes) {
-                box->reference();
+    // merges the appended `row` into the results of the previous queries it matches
+    void add_candidate_(std::uint32_t row) {
+        auto && rows = all_boxes.rows;
+        auto insert = [this,&rows,row](std::vector<std::uint32_t>& results) {
+            auto pos = std::upper_bound(results.begin(), results.end(), row, [this,&rows](auto a, auto b) {
+                return less_(*rows[a].box, *rows[b].box);
+            });
+            results.insert(pos, row);
+        };
+        auto mask = categories_mask_();
+        for (auto && previous: narrowing) {
+            SearchQuery query{ previous.query };
+            if (shown_(rows[row], query, mask) && SearchTable::matches(rows[row], query)) {
+                insert(previous.rows);
             }
-            boxes.clear();
-            for (auto && box: all_boxes) {
-                box->reference();
-                add_if_matches(box);
+        }
+        cache.for_each(generation, [&](const std::string& key, std::vector<std::uint32_t>& results) {
+            // see cache_key_
+            auto end = key.find('\0');
+            CategoriesSet::Mask key_mask;
+            std::memcpy(&key_mask, key.data() + end + 1, sizeof(key_mask));
+            SearchQuery query{ key.substr(0, end) };
+            if (shown_(rows[row], query, key_mask) && SearchTable::matches(rows[row], query)) {
+                insert(results);
             }
-        } else {
-            boxes = all_boxes;
-            std::sort(boxes.begin(), boxes.end(), [](auto* a, auto* b) {
-                return a->name.compare(b->name) < 0;
+        });
+    }
+
+    struct Ranked {
+        int           score;
+        std::size_t   length;
+        std::uint32_t index; // in candidates
+    };
+    static bool better_(const Ranked& a, const Ranked& b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        if (a.length != b.length) {
+            return a.length < b.length;
+        }
+        return a.index < b.index;
+    }
+
+    /* Returns boxes of `candidates` (in model order) with the `top_k` best scored ones moved to the front,
+     * best first; selecting them with a bounded heap takes O(n log k) instead of sorting everything */
+    std::vector<GridBox*> rank_(const std::vector<std::uint32_t>& candidates) const {
+        auto && rows = all_boxes.rows;
+        auto better = &AppBoxes::better_;
+        // heap's front is the worst of the best k
+        std::vector<Ranked> best;
+        auto k = std::min(top_k, candidates.size());
+        best.reserve(k);
+        for (std::uint32_t i = 0; i < candidates.size() && k; ++i) {
+            auto && row = rows[candidates[i]];
+            Ranked ranked{ SearchTable::score(row, search_query), row.key.size(), i };
+            if (best.size() < k) {
+                best.push_back(ranked);
+                std::push_heap(best.begin(), best.end(), better);
+            } else if (better(ranked, best.front())) {
+                std::pop_heap(best.begin(), best.end(), better);
+                best.back() = ranked;
+                std::push_heap(best.begin(), best.end(), better);
+            }
+        }
+        std::sort_heap(best.begin(), best.end(), better);
+
+        std::vector<GridBox*> result;
+        result.reserve(candidates.size());
+        std::vector<bool> taken(candidates.size());
+        for (auto && ranked: best) {
+            result.push_back(rows[candidates[ranked.index]].box);
+            taken[ranked.index] = true;
+        }
+        for (std::uint32_t i = 0; i < candidates.size(); ++i) {
+            if (!taken[i]) {
+                result.push_back(rows[candidates[i]].box);
+            }
+        }
+        return result;
+    }
+
+    static auto categories_of(const Entry& entry) {
+        return entry.desktop_entry_->categories;
+    }
+    // secondary searchable fields: generic name, keywords, comment & program name
+    Glib::ustring fields_of(const Entry& entry_) const {
+        auto && entry = *entry_.desktop_entry_;
+        std::string_view exec{ entry.exec };
+        if (entry.terminal && exec.substr(0, term.size()) == term) {
+            exec.remove_prefix(std::min(term.size() + 1, exec.size()));
+        }
+        auto program = exec.substr(0, exec.find(' '));
+        if (auto slash = program.rfind('/'); slash != std::string_view::npos) {
+            program.remove_prefix(slash + 1);
+        }
+        auto keywords = entry.keywords;
+        std::replace(keywords.begin(), keywords.end(), ';', '\n');
+        return concat(entry.generic_name, '\n', keywords, '\n', entry.comment, '\n', program);
+    }
+protected:
+    AppBoxes(CategoriesSet& set, const GridConfig& config):
+        Glib::ObjectBase(typeid(AppBoxes)),
+        all_boxes{ config.strip_diacritics },
+        categories{ set },
+        top_k{ config.num_col },
+        term{ config.term }
+    {
+        // intentionally left blank
+    }
+    // actions are only shown in search results
+    static bool shown_(const SearchTable::Row& row, const SearchQuery& query, CategoriesSet::Mask mask) {
+        return (mask == ~CategoriesSet::Mask(0) || (row.categories & mask))
+            && (!query.text.empty() || !row.box->entry->is_action());
+    }
+    bool shown_(const SearchTable::Row& row, const SearchQuery& query) const {
+        return shown_(row, query, categories_mask_());
+    }
+    bool matches(const SearchTable::Row& row) const {
+        return shown_(row, search_query) && SearchTable::matches(row, search_query);
+    }
+    void filter_impl(bool restore) {
+        std::vector<GridBox*> next;
+        if (restore) {
+            next.reserve(all_boxes.rows.size());
+            for (auto && row: all_boxes.rows) {
+                if (!row.box->entry->is_action()) {
+                    next.push_back(row.box);
+                }
+            }
+            std::stable_sort(next.begin(), next.end(), [this](auto* a, auto* b) {
+                return less_(*a, *b);
             });
-            for (auto && box: all_boxes) {
-                box->reference();
-                box->reference();
+            assign_(std::move(next), 2);
+        } else if (search_query.text.empty()) {
+            // candidates are already sorted
+            auto && candidates = candidates_(search_query);
+            next.reserve(candidates.size());
+            for (auto i: candidates) {
+                next.push_back(all_boxes.rows[i].box);
             }
+            assign_(std::move(next), 1);
+        } else {
+            assign_(rank_(candidates_(search_query)), 1);
+        }
+    }
+    // search results are ranked rather than sorted, so changes to them are applied by filtering again
+    void refilter_() {
+        if (bulk) {
+            refilter_pending = true;
+        } else {
+            filter_impl(false);
         }
-        items_changed(0, old_size, boxes.size());
     }
 public:
     void add(GridBox& box) override {
         // TODO: ensure the box does not exist before insertion for all *Boxes classes
-        all_boxes.push_back(&box);
-        auto ok = categories.enabled(box) && (
-            search_criteria.length() == 0
-            ||
-            box.name.casefold().find(search_criteria) != Glib::ustring::npos
-        );
-        if (ok) {
-            auto pos = container_add_sorted(boxes, &box, [](auto* a, auto* b) {
-                return a->name.compare(b->name) > 0;
-            });
+        all_boxes.add(box, box.name, fields_of(*box.entry), categories_of(*box.entry));
+        // appending keeps the other rows in place, so the previous results stay valid
+        add_candidate_(all_boxes.rows.size() - 1);
+        if (is_filtered()) {
+            if (!matches(all_boxes.rows.back())) {
+                return;
+            }
+            // actions are boxed right before the view is filtered, see GridWindow::filter_view
+            if (box.entry->is_action()) {
+                refilter_pending = true;
+            } else {
+                refilter_();
+            }
+            return;
+        }
+        if (matches(all_boxes.rows.back())) {
+            if (bulk) {
+                push_back_(box);
+                return;
+            }
+            auto pos = insert_sorted_(box);
             items_changed(pos, 0, 1);
         }
     }
@@ -356,30 +779,90 @@ public:
         // erase from filtered boxes
         BoxesModel::erase(box);
         // erase from all boxes
-        if (auto to_erase_2 = std::remove(all_boxes.begin(), all_boxes.end(), &box); to_erase_2 != all_boxes.end()) {
-            all_boxes.erase(to_erase_2);
-        }
+        all_boxes.erase(box);
+        invalidate_results();
     }
     void update(GridBox& from, GridBox& to) override {
-        all_boxes.push_back(&to);
-        auto removed = std::remove(all_boxes.begin(), all_boxes.end(), &from);
-        if (removed != all_boxes.end()) {
-            all_boxes.erase(removed, all_boxes.end());
+        all_boxes.update(from, to, to.name, fields_of(*to.entry), categories_of(*to.entry));
+        invalidate_results();
+        BoxesModel::update(from, to);
+        if (is_filtered()) {
+            refilter_();
         }
-        return BoxesModel::update(from, to);
     }
-    void filter(const Glib::ustring& criteria) {
-        auto criteria_ = criteria.casefold();
-        if (search_criteria != criteria_) {
-            search_criteria = criteria_;
-            filter_impl(search_criteria.length() == 0);
+    void end_bulk() override {
+        BoxesModel::end_bulk();
+        if (refilter_pending) {
+            refilter_pending = false;
+            filter_impl(false);
         }
     }
+    // returns whether the view was filtered, which it is not if neither criteria nor matching boxes changed
+    bool filter(const Glib::ustring& criteria) {
+        auto criteria_ = all_boxes.fold(criteria);
+        if (search_query.text != criteria_) {
+            search_query = SearchQuery{ std::move(criteria_) };
+            auto && search_criteria = search_query.text;
+            if (auto lookups = cache.hits + cache.misses; search_criteria.empty() && lookups > cache_lookups_logged) {
+                cache_lookups_logged = lookups;
+                Log::info("Search cache: ", cache.hits, " hits, ", cache.misses, " misses (",
+                    cache.hits * 100 / lookups, "% hit rate)");
+            }
+            refilter_pending = false;
+            filter_impl(search_criteria.empty());
+            return true;
+        }
+        if (refilter_pending && !bulk) {
+            refilter_pending = false;
+            filter_impl(false);
+            return true;
+        }
+        return false;
+    }
+    // drops cached results; must be called whenever boxes change
+    void invalidate_results() {
+        ++generation;
+        narrowing.clear();
+    }
     void on_category_toggled() {
+        narrowing.clear();
         filter_impl(false);
     }
     bool is_filtered() {
-        return search_criteria.length() > 0;
+        return !search_query.text.empty();
+    }
+    // searchable data of `entry` having no box yet, see EntriesModel::box_matching_actions
+    SearchTable::Row search_row(const Entry& entry) const {
+        return all_boxes.make_row(nullptr, entry.desktop_entry_->name, fields_of(entry), categories_of(entry));
+    }
+    SearchQuery search_query_of(const Glib::ustring& criteria) const {
+        return SearchQuery{ all_boxes.fold(criteria) };
+    }
+    /* Returns the box filter(criteria) would show first, or nullptr if there is none or criteria is empty.
+     * Only the search table is consulted, so it works before the view is filtered;
+     * the candidates are kept for the filter pass that follows */
+    GridBox* best_match(const Glib::ustring& criteria) {
+        SearchQuery query{ all_boxes.fold(criteria) };
+        if (query.text.empty()) {
+            return nullptr;
+        }
+        auto && rows = all_boxes.rows;
+        auto && candidates = candidates_(query);
+        GridBox* best_box = nullptr;
+        Ranked best{};
+        for (std::uint32_t i = 0; i < candidates.size(); ++i) {
+            auto && row = rows[candidates[i]];
+            Ranked ranked{ SearchTable::score(row, query), row.key.size(), i };
+            if (!best_box || better_(ranked, best)) {
+                best = ranked;
+                best_box = row.box;
+            }
+        }
+        return best_box;
+    }
+protected:
+    bool less_(const GridBox& a, const GridBox& b) const override {
+        return a.entry->collation_key < b.entry->collation_key;
     }
 };
 
@@ -415,7 +898,23 @@ class GridWindow : public PlatformWindow {
         void remove_box_by_desktop_id(std::string_view desktop_id);
 
         void build_grids();
+        // see BoxesModel::begin_bulk; end_bulk also rebuilds grids
+        void begin_bulk();
+        void end_bulk();
+        // emitted with the search criteria right before the view is filtered or searched by them
+        sigc::signal<void, const Glib::ustring&> signal_search;
+        // runs the filter pass again unless one is pending, e.g. when more boxes may match the search
+        void search_again();
         void toggle_pinned(GridBox& box);
+        // drops cached search results, see AppBoxes::invalidate_results
+        void invalidate_search();
+        // see AppBoxes::search_row
+        SearchTable::Row search_row(const Entry& entry) const {
+            return apps_boxes->search_row(entry);
+        }
+        SearchQuery search_query_of(const Glib::ustring& criteria) const {
+            return apps_boxes->search_query_of(criteria);
+        }
         void set_description(const Glib::ustring&);
         void save_cache();
         void run_box(GridBox& box);
@@ -436,24 +935,42 @@ class GridWindow : public PlatformWindow {
         void ref_categories(const GridBox& box);
         void unref_categories(GridBox& box);
         
-        std::list<GridBox>  all_boxes {}; // stores all applications buttons
+        SlotStorage<GridBox> all_boxes; // stores all applications buttons
+        // desktop id -> box in all_boxes
+        std::unordered_map<std::string_view, SlotStorage<GridBox>::Handle> boxes_by_id;
         Glib::RefPtr<AppBoxes> apps_boxes;   // common boxes (possibly filtered)
-        Glib::RefPtr<FavBoxes> fav_boxes;    // favourites (most clicked)
+        Glib::RefPtr<FavBoxes> fav_boxes;    // favourites (best frecency rank)
         Glib::RefPtr<PinnedBoxes> pinned_boxes; // boxes pinned by user
 
         CategoriesSet categories;
 
+        // unpinned boxes by frecency rank, used only if config.favs;
+        // the worst favourite and the best of the rest are on top
+        IndexedHeap<GridBox*, RankGreater> fav_ranking;
+        IndexedHeap<GridBox*, RankLess>    rest_ranking;
+
         bool pins_changed = false;
         bool favs_changed = false;
 
+        guint filter_tick{ 0 }; // tick callback running the pending filter pass, 0 if none
+
         void focus_first_box();
+        void schedule_filter();
+        void flush_filter();
         void filter_view();
         void refresh_separators();
+        // moves `box` between models (or to its sorted position if `from` == `to`)
+        void move_box_(GridBox& box, AbstractBoxes& from, Gtk::FlowBox& from_grid, AbstractBoxes& to, Gtk::FlowBox& to_grid);
+        void rank_insert_(GridBox& box);
+        void rank_erase_(GridBox& box);
+        // promotes/demotes boxes so that favourites are the config.num_col best ranked ones
+        void rerank_();
 };
 
 template <typename ... Args>
 GridBox& GridWindow::emplace_box(Args&& ... args) {
-    auto& ab = this -> all_boxes.emplace_back(std::forward<Args>(args)...);
+    auto [handle, ab] = this -> all_boxes.emplace(std::forward<Args>(args)...);
+    boxes_by_id.insert_or_assign(ab.entry->desktop_id, handle);
     ref_categories(ab);
     ab.reference();
     ab.reference();
@@ -465,15 +982,23 @@ GridBox& GridWindow::emplace_box(Args&& ... args) {
         boxes = fav_boxes.get();
     }
     boxes->add(ab);
+    if (!stats.pinned) {
+        rank_insert_(ab);
+    }
     return ab;
 }
 
 struct CacheEntry {
-    std::string desktop_id;
-    int clicks;
-    CacheEntry(std::string, int);
+    std::string  desktop_id;
+    int          clicks;
+    double       rank;
+    std::int64_t last_launch;
+    CacheEntry(std::string, int, double, std::int64_t);
 };
 
+// desktop id -> stats of pinned & launched entries; keys view into the pins/favs they were built from
+using StatsIndex = std::unordered_map<std::string_view, Stats>;
+
 struct GridInstance: public Instance {
     GridWindow& window;
 
@@ -501,4 +1026,7 @@ struct GridInstance: public Instance {
  * */
 std::vector<fs::path>       get_app_dirs(void);
 std::vector<std::string>    get_pinned(const fs::path& pinned_file);
-std::vector<CacheEntry>     get_favourites(ns::json&&, int);
+std::vector<CacheEntry>     get_favourites(ns::json&&);
+StatsIndex                  index_stats(Span<std::string> pins, Span<CacheEntry> favs, std::size_t n_favs);
+double                      frecency_rank(double score, std::int64_t time);
+double                      frecency_score(double rank, std::int64_t time);
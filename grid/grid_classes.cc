@@ -15,7 +15,9 @@
  * Re-worked for Gtkmm 3.0 by Louis Melahn, L.C. January 31, 2014.
  * */
 
+#include <ctime>
 #include <fstream>
+#include <utility>
 
 #include "charconv-compat.h"
 #include "nwg_tools.h"
@@ -129,15 +131,14 @@ GridConfig::GridConfig(const InputParser& parser, const Glib::RefPtr<Gdk::Screen
     }
 
 
-    if (pins || favs) {
-        auto cache_home = get_cache_home();
-        if (pins) {
-            pinned_file = cache_home / "nwg-pin-cache";
-        }
-        if (favs) {
-            cached_file = cache_home / "nwg-fav-cache";
-        }
+    auto cache_home = get_cache_home();
+    if (pins) {
+        pinned_file = cache_home / "nwg-pin-cache";
     }
+    if (favs) {
+        cached_file = cache_home / "nwg-fav-cache";
+    }
+    index_file = cache_home / "nwg-grid-index";
 
     if (auto i_size = parser.getCmdOption("-s"); !i_size.empty()){
         icon_size = parse_icon_size(i_size);
@@ -172,6 +173,19 @@ GridConfig::GridConfig(const InputParser& parser, const Glib::RefPtr<Gdk::Screen
 	}
     }
 
+    if (!config_source.empty()) {
+        auto item = config_source.find("strip-diacritics");
+        if (item != config_source.end()) {
+            try {
+                strip_diacritics = item->get<bool>();
+            }
+            catch (...) {
+                Log::error("Failed to read 'strip-diacritics' value from config JSON");
+                throw;
+            }
+        }
+    }
+
     categories = !parser.cmdOptionExists("-no-categories");
 
     if (categories) {
@@ -208,6 +222,16 @@ GridConfig::GridConfig(const InputParser& parser, const Glib::RefPtr<Gdk::Screen
             json_at(map, "AudioVideo") = "Multimedia"sv;
         }
     }
+    if (categories) {
+        for (auto && [name, _]: config_source["categories"].items()) {
+            if (category_names.size() == MAX_CATEGORIES) {
+                Log::warn("Too many categories, only the first ", MAX_CATEGORIES, " are used");
+                break;
+            }
+            category_names.emplace_back(name);
+            category_labels.emplace_back(category::localize(config_source, name));
+        }
+    }
 }
 
 static Gtk::Widget* make_widget(const Glib::RefPtr<Glib::Object>& object) {
@@ -236,7 +260,7 @@ GridWindow::GridWindow(GridConfig& config):
 {
     searchbox
         .signal_search_changed()
-        .connect(sigc::mem_fun(*this, &GridWindow::filter_view));
+        .connect(sigc::mem_fun(*this, &GridWindow::schedule_filter));
     searchbox.set_placeholder_text("Type to search");
     searchbox.set_sensitive(true);
     searchbox.set_name("searchbox");
@@ -255,7 +279,7 @@ GridWindow::GridWindow(GridConfig& config):
 
     categories_box.set_sort_func(&sort_by_name);
 
-    apps_boxes = AppBoxes::create(categories);
+    apps_boxes = AppBoxes::create(categories, config);
     pinned_boxes = PinnedBoxes::create();
     fav_boxes = FavBoxes::create();
 
@@ -339,11 +363,9 @@ GridWindow::GridWindow(GridConfig& config):
 }
 
 GridWindow::~GridWindow() {
-    // this is important: each button frees it's data in dtor,
-    // and the data must be freed while GridWindow is alive
-    categories_box.foreach([this](auto & child){
-        categories_box.remove(child);
-    });
+    if (filter_tick) {
+        remove_tick_callback(filter_tick);
+    }
 }
 
 bool GridWindow::on_button_press_event(GdkEventButton *event) {
@@ -361,6 +383,18 @@ bool GridWindow::on_key_press_event(GdkEventKey* key_event) {
             this -> searchbox.set_text("");
             break;
         case GDK_KEY_Return:
+            // the user is still typing: launch the best match straight from the search table,
+            // without waiting for the results to be shown
+            if (filter_tick || searchbox.is_focus()) {
+                signal_search.emit(searchbox.get_text());
+                if (auto* box = apps_boxes->best_match(searchbox.get_text())) {
+                    run_box(*box);
+                    return true;
+                }
+            }
+            // activate what matches the latest input
+            flush_filter();
+            break;
         case GDK_KEY_Left:
         case GDK_KEY_Right:
         case GDK_KEY_Up:
@@ -416,12 +450,47 @@ inline auto build_grid = [](auto& grid, auto& container, auto num_col) {
     disable_flowbox_child_focus(grid);
 };
 
-/* Called each time `search_entry` changes, rebuilds `apps_grid` according to search criteria */
+/* Called each time `search_entry` changes; the actual filtering is deferred to the next frame,
+ * so that changes made within one frame (fast typing, pasting) result in a single pass
+ * over the latest text, and passes for outdated text never run */
+void GridWindow::schedule_filter() {
+    if (filter_tick) {
+        return;
+    }
+    filter_tick = add_tick_callback([this](const Glib::RefPtr<Gdk::FrameClock>&) {
+        filter_tick = 0;
+        filter_view();
+        return false;
+    });
+}
+
+/* Runs the pending filter pass, if any, immediately */
+void GridWindow::flush_filter() {
+    if (filter_tick) {
+        remove_tick_callback(filter_tick);
+        filter_tick = 0;
+        filter_view();
+    }
+}
+
+/* Rebuilds `apps_grid` according to search criteria */
 void GridWindow::filter_view() {
-    apps_boxes->filter(searchbox.get_text());
-    this -> refresh_separators();
-    this -> focus_first_box();
-    refresh_max_children_per_line(apps_grid, *apps_boxes.get(), config.num_col);
+    auto && criteria = searchbox.get_text();
+    // lets boxes matching the criteria be added first, see EntriesModel::box_matching_actions
+    signal_search.emit(criteria);
+    if (apps_boxes->filter(criteria)) {
+        this -> refresh_separators();
+        this -> focus_first_box();
+        refresh_max_children_per_line(apps_grid, *apps_boxes.get(), config.num_col);
+    }
+}
+
+/* Filters the view again if it is searched and no filter pass is pending;
+ * boxes are only regrouped if the ones added since the last pass match the search */
+void GridWindow::search_again() {
+    if (!filter_tick && apps_boxes->is_filtered()) {
+        filter_view();
+    }
 }
 
 /* Sets separators' visibility according to grid status */
@@ -437,6 +506,8 @@ void GridWindow::refresh_separators() {
 }
 
 void GridWindow::build_grids() {
+    // entries may have been added or removed
+    rerank_();
     auto num_col = config.num_col;
     build_grid(this->pinned_grid, *pinned_boxes.get(), num_col);
     build_grid(this->favs_grid, *fav_boxes.get(), num_col);
@@ -450,6 +521,23 @@ void GridWindow::build_grids() {
     this -> refresh_separators();
 }
 
+void GridWindow::begin_bulk() {
+    pinned_boxes->begin_bulk();
+    fav_boxes->begin_bulk();
+    apps_boxes->begin_bulk();
+}
+
+void GridWindow::end_bulk() {
+    pinned_boxes->end_bulk();
+    fav_boxes->end_bulk();
+    apps_boxes->end_bulk();
+    build_grids();
+}
+
+void GridWindow::invalidate_search() {
+    apps_boxes->invalidate_results();
+}
+
 void GridWindow::focus_first_box() {
     if (apps_boxes->is_filtered() && apps_boxes->size()) {
         apps_boxes->front()->grab_focus();
@@ -470,35 +558,11 @@ void GridWindow::set_description(const Glib::ustring& text) {
     this->description.set_text(text);
 }
 
-void GridWindow::toggle_pinned(GridBox& box) {
-    // pins changed, we'll need to update the cache
-    this->pins_changed = true;
-
-    // disable prelight
-    box.unset_state_flags(Gtk::STATE_FLAG_PRELIGHT);
-
-    auto& stats = this->stats_of(box);
-    auto is_pinned = stats.pinned == Stats::Pinned;
-    stats.pinned = Stats::PinTag{ !is_pinned };
-
-    auto* from_grid = &this->apps_grid;
-    AbstractBoxes* from = apps_boxes.get();
-
-    if (stats.favorite) {
-        from_grid = &this->favs_grid;
-        from = this->fav_boxes.get();
-    }
-
-    AbstractBoxes* to = this->pinned_boxes.get();
-    auto* to_grid = &this->pinned_grid;
-    if (is_pinned) {
-        std::swap(from, to);
-        std::swap(from_grid, to_grid);
-    }
+void GridWindow::move_box_(GridBox& box, AbstractBoxes& from, Gtk::FlowBox& from_grid, AbstractBoxes& to, Gtk::FlowBox& to_grid) {
     box.reference(); // reference count decreases when unparenting
     box.reference(); // TODO: this reference is required (errors otherwise), but why?
     box.reference();
-    from->erase(box);
+    from.erase(box);
     // FlowBox { ... FlowBoxChild { box } ... }
     // it is necessary to remove box from FlowBoxChild
     // and then FlowBoxChild from FlowBox
@@ -507,13 +571,91 @@ void GridWindow::toggle_pinned(GridBox& box) {
         //if (auto grid = parent->get_parent()) {
         //    grid->remove(*parent);
         //}
-        from_grid->remove(*parent);
+        from_grid.remove(*parent);
         parent->remove(box);
     }
-    to->add(box);
+    to.add(box);
     auto num_col = config.num_col;
-    refresh_max_children_per_line(*from_grid, *from, num_col);
-    refresh_max_children_per_line(*to_grid, *to, num_col);
+    refresh_max_children_per_line(from_grid, from, num_col);
+    refresh_max_children_per_line(to_grid, to, num_col);
+}
+
+void GridWindow::rank_insert_(GridBox& box) {
+    // actions are loaded on demand, so they can't be favourites
+    if (!config.favs || box.entry->is_action()) {
+        return;
+    }
+    if (stats_of(box).favorite) {
+        fav_ranking.push(&box);
+    } else {
+        rest_ranking.push(&box);
+    }
+}
+
+void GridWindow::rank_erase_(GridBox& box) {
+    fav_ranking.erase(&box);
+    rest_ranking.erase(&box);
+}
+
+/* Keeps at most num_col favourites, each ranked not worse than any other unpinned box.
+ * Each launch changes one rank, so usually at most one box is swapped, in O(log n) */
+void GridWindow::rerank_() {
+    if (!config.favs) {
+        return;
+    }
+    auto promote = [this]() {
+        auto* box = rest_ranking.top();
+        rest_ranking.erase(box);
+        fav_ranking.push(box);
+        move_box_(*box, *apps_boxes.get(), apps_grid, *fav_boxes.get(), favs_grid);
+    };
+    auto demote = [this]() {
+        auto* box = fav_ranking.top();
+        fav_ranking.erase(box);
+        stats_of(*box).favorite = Stats::Common;
+        rest_ranking.push(box);
+        move_box_(*box, *fav_boxes.get(), favs_grid, *apps_boxes.get(), apps_grid);
+    };
+    // never launched boxes are not favourites
+    auto launched = [](auto* box) {
+        return box->entry->stats.rank > -std::numeric_limits<double>::infinity();
+    };
+    while (fav_ranking.size() > config.num_col) {
+        demote();
+    }
+    while (fav_ranking.size() < config.num_col && !rest_ranking.empty() && launched(rest_ranking.top())) {
+        promote();
+    }
+    while (!fav_ranking.empty() && !rest_ranking.empty() && RankLess{}(fav_ranking.top(), rest_ranking.top())) {
+        demote();
+        promote();
+    }
+}
+
+void GridWindow::toggle_pinned(GridBox& box) {
+    // pins changed, we'll need to update the cache
+    this->pins_changed = true;
+
+    // disable prelight
+    box.unset_state_flags(Gtk::STATE_FLAG_PRELIGHT);
+
+    auto& stats = this->stats_of(box);
+    if (stats.pinned) {
+        stats.pinned = Stats::Unpinned;
+        move_box_(box, *pinned_boxes.get(), pinned_grid, *apps_boxes.get(), apps_grid);
+        // may become favourite again, see rerank_
+        rank_insert_(box);
+    } else {
+        stats.pinned = Stats::Pinned;
+        rank_erase_(box);
+        if (stats.favorite) {
+            stats.favorite = Stats::Common;
+            move_box_(box, *fav_boxes.get(), favs_grid, *pinned_boxes.get(), pinned_grid);
+        } else {
+            move_box_(box, *apps_boxes.get(), apps_grid, *pinned_boxes.get(), pinned_grid);
+        }
+    }
+    rerank_();
 
     // refresh filters
     refresh_separators();
@@ -537,20 +679,18 @@ void GridWindow::save_cache() {
     }
     if (config.favs && favs_changed) {
         try {
-            ns::json favs_cache;
-            // find min positive clicks count
-            decltype(Stats::clicks) min = 1000000; // avoid including <limits>
-            for (auto& box : this->all_boxes) {
-                if (auto clicks = stats_of(box).clicks; clicks > 0) {
-                    min = std::min(min, clicks);
-                }
-            }
-            // only save positives, substract min to keep clicks low, but preserve order
-            for (auto& box : this->all_boxes) {
-                if (auto clicks = stats_of(box).clicks - min + 1; clicks > 0) {
-                    favs_cache.emplace(box.entry->desktop_id, clicks);
+            ns::json favs_cache = ns::json::object();
+            // only save launched entries; the score is stored as of the last launch
+            all_boxes.for_each([this,&favs_cache](auto& box) {
+                auto && stats = stats_of(box);
+                if (stats.rank > -std::numeric_limits<double>::infinity() && !box.entry->is_action()) {
+                    favs_cache[std::string{ box.entry->desktop_id }] = {
+                        { "clicks", stats.clicks },
+                        { "score", frecency_score(stats.rank, stats.last_launch) },
+                        { "last", stats.last_launch }
+                    };
                 }
-            }
+            });
             save_json(favs_cache, config.cached_file);
         } catch (const ns::json::exception& e) {
             Log::error("unable to save favs: ", e.what());
@@ -567,6 +707,7 @@ void GridWindow::on_show() {
     hadjustment->set_value(hadjustment->get_lower());
     vadjustment->set_value(vadjustment->get_lower());
     searchbox.set_text("");
+    flush_filter();
     PlatformWindow::on_show();
     grab_focus();
     focus_first_box();
@@ -581,7 +722,19 @@ bool GridWindow::on_delete_event(GdkEventAny* event) {
 
 void GridWindow::run_box(GridBox& box) {
     favs_changed = true;
-    ++stats_of(box).clicks;
+    auto && stats = stats_of(box);
+    auto now = static_cast<std::int64_t>(std::time(nullptr));
+    ++stats.clicks;
+    stats.rank = frecency_rank(frecency_score(stats.rank, now) + 1, now);
+    stats.last_launch = now;
+    if (fav_ranking.contains(&box)) {
+        fav_ranking.update(&box);
+        // keep the favourites row sorted
+        move_box_(box, *fav_boxes.get(), favs_grid, *fav_boxes.get(), favs_grid);
+    } else if (rest_ranking.contains(&box)) {
+        rest_ranking.update(&box);
+    }
+    rerank_();
     auto& cmd = exec_of(box);
     // TODO: use special flag
     if (cmd.find(config.term) == 0) {
@@ -597,17 +750,17 @@ void GridWindow::run_box(GridBox& box) {
     hide();
 }
 
-inline auto with_box_by_id = [](auto && container, auto && desktop_id, auto && foo) {
-    auto cmp = [&desktop_id](auto && box) { return box.entry->desktop_id == desktop_id; };
-    if (auto iter = std::find_if(container.begin(), container.end(), cmp); iter != container.end()) {
-        foo(iter);
-    }
-};
-
 void GridWindow::remove_box_by_desktop_id(std::string_view desktop_id) {
-    with_box_by_id(all_boxes, desktop_id, [this](auto && iter) {
-        auto && box = *iter;
+    auto iter = boxes_by_id.find(desktop_id);
+    if (iter == boxes_by_id.end()) {
+        return;
+    }
+    auto handle = iter->second;
+    boxes_by_id.erase(iter);
+    if (auto* box_ptr = all_boxes.get(handle)) {
+        auto && box = *box_ptr;
         unref_categories(box);
+        rank_erase_(box);
         // delete references to the widget from models
         pinned_boxes->erase(box);
         fav_boxes->erase(box);
@@ -620,14 +773,20 @@ void GridWindow::remove_box_by_desktop_id(std::string_view desktop_id) {
             }
         }
         // delete the actual widget
-        all_boxes.erase(iter);
-    });
+        all_boxes.erase(handle);
+    }
 }
 
 void GridWindow::update_box_by_id(std::string_view desktop_id, GridBox && new_box) {
-    with_box_by_id(all_boxes, desktop_id, [this,&new_box](auto && iter) {
-        auto && box = *iter;
-        auto && new_box_ref = all_boxes.emplace_front(std::move(new_box));
+    auto iter = boxes_by_id.find(desktop_id);
+    if (iter == boxes_by_id.end()) {
+        return;
+    }
+    auto handle = iter->second;
+    if (auto* box_ptr = all_boxes.get(handle)) {
+        auto && box = *box_ptr;
+        auto [new_handle, new_box_ref] = all_boxes.emplace(std::move(new_box));
+        iter->second = new_handle;
 
         ref_categories(new_box_ref);
         unref_categories(box);
@@ -635,133 +794,103 @@ void GridWindow::update_box_by_id(std::string_view desktop_id, GridBox && new_bo
         pinned_boxes->update(box, new_box_ref);
         fav_boxes->update(box, new_box_ref);
         apps_boxes->update(box, new_box_ref);
-        all_boxes.erase(iter);
-    });
+        fav_ranking.replace(&box, &new_box_ref);
+        rest_ranking.replace(&box, &new_box_ref);
+        all_boxes.erase(handle);
+    }
 }
 
 void GridWindow::ref_categories(const GridBox& box) {
-    for (auto && category: box.entry->desktop_entry_->categories) {
-        if (auto [index, inserted] = categories.ref(category); inserted) {
-            std::string_view category{ index->category };
-            auto* button = Gtk::make_managed<CategoryButton>(index->category, categories, index);
-            index->button = button;
-            button->show();
-            categories_box.insert(*button, -1);
-            button->set_active(false);
-
-            auto* fboxchild = dynamic_cast<Gtk::FlowBoxChild*>(button->get_parent());
-            if (fboxchild) {
-                fboxchild->set_can_focus(false);
-            }
+    CategoriesSet::for_each(box.entry->desktop_entry_->categories, [this](auto id) {
+        if (!categories.ref(id)) {
+            return;
+        }
+        auto* button = Gtk::make_managed<CategoryButton>(config.category_labels[id]);
+        categories.categories[id].button = button;
+        button->show();
+        categories_box.insert(*button, -1);
+        button->set_active(false);
+
+        auto* fboxchild = dynamic_cast<Gtk::FlowBoxChild*>(button->get_parent());
+        if (fboxchild) {
+            fboxchild->set_can_focus(false);
+        }
 
-            // initial state: ALL active, others disabled
-            // any: enable clicked, disable ALL & other active buttons
-            // C+any: disable ALL, enable clicked
+        // initial state: ALL active, others disabled
+        // any: enable clicked, disable ALL & other active buttons
+        // C+any: disable ALL, enable clicked
 
-            button->signal_toggled().connect([this, category, button]() {
-                auto active = button->get_active();
-                if (active) {
-                    categories_all.set_active(false);
-                }
-                categories.all_enabled = categories_all.get_active();
-                categories.toggle(category);
+        button->signal_toggled().connect([this, id, button]() {
+            auto active = button->get_active();
+            if (active) {
+                categories_all.set_active(false);
+            }
+            categories.all_enabled = categories_all.get_active();
+            categories.toggle(id);
 
-                this->apps_boxes->on_category_toggled();
-                this -> refresh_separators();
-                this -> focus_first_box();
-                refresh_max_children_per_line(apps_grid, *apps_boxes.get(), config.num_col);
-            });
-        }
-    }
+            this->apps_boxes->on_category_toggled();
+            this -> refresh_separators();
+            this -> focus_first_box();
+            refresh_max_children_per_line(apps_grid, *apps_boxes.get(), config.num_col);
+        });
+    });
 }
 
 void GridWindow::unref_categories(GridBox& box) {
-    for (auto && category: box.entry->desktop_entry_->categories) {
-        if (auto [index, deleted] = categories.unref(category); deleted) {
-            auto& button = *index->button;
-            auto* parent = dynamic_cast<Gtk::Widget*>(button.get_parent());
-            if (!parent) {
-                throw std::logic_error{ "CategoryButton::get_parent returned non-widget" };
-            }
-            categories_box.remove(*parent);
+    CategoriesSet::for_each(box.entry->desktop_entry_->categories, [this](auto id) {
+        if (!categories.unref(id)) {
+            return;
         }
-    }
+        auto& button = *std::exchange(categories.categories[id].button, nullptr);
+        auto* parent = dynamic_cast<Gtk::Widget*>(button.get_parent());
+        if (!parent) {
+            throw std::logic_error{ "CategoryButton::get_parent returned non-widget" };
+        }
+        categories_box.remove(*parent);
+    });
 }
 
-CategoryButton::CategoryButton(const std::string& name, CategoriesSet& set, CategoriesSet::Index index):
-    Gtk::ToggleButton{ name }, categories{ set }, index{ index }
+CategoryButton::CategoryButton(const std::string& name):
+    Gtk::ToggleButton{ name }
 {
     modifiers = Gtk::AccelGroup::get_default_mod_mask();
 }
 
-CategoryButton::~CategoryButton() {
-    categories.delete_by_index(index);
-}
-
-bool CategoriesSet::toggle(std::string_view category) {
-    if (auto iter = active_categories.find(category); iter != active_categories.end()) {
-        active_categories.extract(iter);
-        all_enabled = active_categories.empty();
-        return false;
-    } else {
-        active_categories.emplace_hint(iter, category);
+bool CategoriesSet::toggle(Id id) {
+    auto bit = Mask(1) << id;
+    active_categories ^= bit;
+    if (active_categories & bit) {
         return true;
     }
+    all_enabled = !active_categories;
+    return false;
 }
 
-std::pair<CategoriesSet::Index, bool> CategoriesSet::ref(std::string_view category) {
-    std::pair<Index, bool> ret{ {}, false };
-    if (auto iter = categories.find(category); iter != categories.end()) {
-        ++iter->second->refs;
-        return ret;
-    } else {
-        auto& ref = categories_store.emplace_front(category);
-        ret.first = categories_store.begin();
-        categories.emplace_hint(iter, ref.category, ret.first);
-        ret.second = true;
-    }
-    return ret;
-}
-
-std::pair<CategoriesSet::Index, bool> CategoriesSet::unref(std::string_view category) {
-    std::pair<Index, bool> ret{ {}, false };
-    if (auto iter = categories.find(category); iter != categories.end()) {
-        --iter->second->refs;
-        ret.second = !iter->second->refs;
-        if (ret.second) {
-            auto node = categories.extract(iter);
-            active_categories.extract(category);
-            ret.first = node.mapped();
-        }
-        all_enabled = active_categories.empty();
-        return ret;
+bool CategoriesSet::ref(Id id) {
+    if (id >= categories.size()) {
+        categories.resize(id + 1);
     }
-    throw std::logic_error{ "Trying to unref non-existing category" };
-}
-
-void CategoriesSet::delete_by_index(Index index) {
-    categories_store.erase(index);
+    return categories[id].refs++ == 0;
 }
 
-inline auto enabled_impl = [](auto && cs) {
-    return [&](auto c) { return cs.find(c) != cs.end(); };
-};
-
-bool CategoriesSet::enabled(std::string_view category) const {
-    return all_enabled || enabled_impl(active_categories)(category);
+bool CategoriesSet::unref(Id id) {
+    if (id >= categories.size() || categories[id].refs == 0) {
+        throw std::logic_error{ "Trying to unref non-existing category" };
+    }
+    auto deleted = --categories[id].refs == 0;
+    if (deleted) {
+        active_categories &= ~(Mask(1) << id);
+    }
+    all_enabled = !active_categories;
+    return deleted;
 }
 
-bool CategoriesSet::enabled(const GridBox& box) const {
-    auto && categories = box.entry->desktop_entry_->categories;
-    return all_enabled || std::any_of(
-        categories.begin(),
-        categories.end(),
-        enabled_impl(active_categories)
-    );
+bool CategoriesSet::enabled(Mask categories) const {
+    return all_enabled || (categories & active_categories);
 }
 
-GridBox::GridBox(Glib::ustring name, Glib::ustring comment, Entry& entry)
-: name(std::move(name)), comment(std::move(comment)), entry{ &entry } {
+GridBox::GridBox(Glib::ustring name, Entry& entry)
+: name(std::move(name)), entry{ &entry } {
     // As we sort dynamically by actual names, we need to avoid shortening them, or long names will remain unsorted.
     // See the issue: https://github.com/nwg-piotr/nwg-launchers/issues/128
     auto display_name = this->name;
@@ -780,7 +909,8 @@ GridWindow& GridBox::get_toplevel() {
 
 bool GridBox::on_button_press_event(GdkEventButton* event) {
     auto& toplevel = get_toplevel();
-    if (toplevel.config.pins && event->button == 3) { // right-clicked
+    // actions are loaded on demand, so pinned ones would be missing after restart
+    if (toplevel.config.pins && event->button == 3 && !entry->is_action()) { // right-clicked
         toplevel.toggle_pinned(*this);
     } else {
         this -> activate();
@@ -792,13 +922,14 @@ bool GridBox::on_focus_in_event(GdkEventFocus* event) {
     (void) event; // suppress warning
 
     auto& toplevel = get_toplevel();
-    toplevel.set_description(comment);
+    toplevel.set_description(entry->desktop_entry().comment);
     return Gtk::Button::on_focus_in_event(event);
 }
 
 void GridBox::on_enter() {
+    // the comment is only converted when shown
     auto& toplevel = get_toplevel();
-    toplevel.set_description(comment);
+    toplevel.set_description(entry->desktop_entry().comment);
     return Gtk::Button::on_enter();
 }
 
@@ -5,167 +5,645 @@
  * Project: https://github.com/nwg-piotr/nwg-launchers
  * License: GPL3
  * */
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <set>
+#include <thread>
+
 #include "grid_entries.h"
 #include "on_desktop_entry.h"
 #include "log.h"
 
 DesktopEntryConfig::DesktopEntryConfig(const GridConfig& config):
     term{ config.term },
-    name_ln{ concat("Name[", config.lang, "]=") },
-    comment_ln{ concat("Comment[", config.lang, "]=") },
-    home{ get_home_dir() },
-    config_source{ config.config_source }
+    lang{ config.lang },
+    home{ get_home_dir() }
 {
+    for (std::size_t id = 0; id < config.category_names.size(); ++id) {
+        category_ids.emplace(config.category_names[id], id);
+    }
+    if (auto* desktops = getenv("XDG_CURRENT_DESKTOP")) {
+        for (auto && desktop: split_string(desktops, ":")) {
+            if (!desktop.empty()) {
+                current_desktops.emplace_back(desktop);
+            }
+        }
+    }
+}
+
+ExecutableCache::ExecutableCache() {
+    if (auto* path = getenv("PATH")) {
+        for (auto && dir: split_string(path, ":")) {
+            if (!dir.empty()) {
+                path_dirs.emplace_back(dir);
+            }
+        }
+    }
+}
+
+bool ExecutableCache::find(const std::string& program) {
+    if (auto iter = found.find(program); iter != found.end()) {
+        return iter->second;
+    }
+    bool exists = false;
+    if (program.find('/') != std::string::npos) {
+        exists = ::access(program.c_str(), X_OK) == 0;
+    } else {
+        for (auto && dir: path_dirs) {
+            if (::access(concat(dir, "/", program).c_str(), X_OK) == 0) {
+                exists = true;
+                break;
+            }
+        }
+    }
+    found.emplace(program, exists);
+    return exists;
+}
+
+
+// settings affecting the result of parse_desktop_entry
+static std::string index_fingerprint(const GridConfig& config) {
+    std::string categories;
     if (config.categories) {
-        for (auto & [k, _] : config.config_source["categories"].items()) {
-            known_categories.push_back(k);
+        categories = json_at(config.config_source, "categories").dump();
+    }
+    auto* desktops = getenv("XDG_CURRENT_DESKTOP");
+    return concat(config.term, "\n", config.lang, "\n", get_home_dir(), "\n", categories, "\n", desktops ? desktops : "");
+}
+
+/* Runs `foo(i)` for each i in [0, n) on a pool of worker threads sized to the CPU count */
+template <typename F>
+void parallel_for(std::size_t n, F&& foo) {
+    std::size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min(n_threads, n);
+    std::atomic_size_t next{ 0 };
+    auto worker = [&]() {
+        for (auto i = next++; i < n; i = next++) {
+            foo(i);
         }
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < n_threads; ++i) {
+        try {
+            threads.emplace_back(worker);
+        } catch (const std::system_error& e) {
+            // the calling thread will do the rest
+            Log::warn("Failed to start worker thread: ", e.what());
+            break;
+        }
+    }
+    // the calling thread works too
+    worker();
+    for (auto && thread: threads) {
+        thread.join();
+    }
+}
+
+/* Parses file `name` in the directory `dir_fd`, allocating the entry only if it is Ok;
+ * safe to call from worker threads */
+static std::pair<DesktopIndex::State, std::unique_ptr<DesktopEntry>>
+parse_entry(int dir_fd, const char* name, const DesktopEntryConfig& config) {
+    DesktopEntry parsed{};
+    auto state = parse_desktop_entry(dir_fd, name, config, parsed);
+    std::unique_ptr<DesktopEntry> desktop_entry;
+    if (state == DesktopIndex::Ok) {
+        desktop_entry = std::make_unique<DesktopEntry>(std::move(parsed));
     }
+    return { state, std::move(desktop_entry) };
+}
+static std::pair<DesktopIndex::State, std::unique_ptr<DesktopEntry>>
+parse_entry(const fs::path& file, const DesktopEntryConfig& config) {
+    return parse_entry(AT_FDCWD, file.c_str(), config);
 }
 
+/* .desktop file found during the initial scan */
+struct LoadJob {
+    EntriesManager::IdInfo*       info;
+    fs::path                      path;
+    int                           dir_fd;          // see DirWalker
+    std::size_t                   name_at;         // offset of the file name in path
+    struct stat                   st{};            // taken on a worker thread
+    bool                          cached{ false };  // taken from the index
+    DesktopIndex::State           state{ DesktopIndex::Invalid };
+    std::unique_ptr<DesktopEntry> entry{};
+};
 
-inline bool looks_like_desktop_file(const Glib::RefPtr<Gio::File>& file) {
-    fs::path path{ file->get_path() };
-    return path.extension() == ".desktop";
+inline bool looks_like_desktop_file(std::string_view name) {
+    constexpr std::string_view extension{ ".desktop" };
+    return name.size() > extension.size() && name.substr(name.size() - extension.size()) == extension;
 }
-inline bool looks_like_desktop_file(const fs::directory_entry& entry) {
-    auto && path = entry.path();
-    return path.extension() == ".desktop";
+inline bool looks_like_desktop_file(const Glib::RefPtr<Gio::File>& file) {
+    return looks_like_desktop_file(file->get_basename());
 }
 inline bool can_be_loaded(const Glib::RefPtr<Gio::File>& file) {
     auto file_type = file->query_file_type();
     return file_type == Gio::FILE_TYPE_REGULAR;
 }
-inline bool can_be_loaded(const fs::directory_entry& entry) {
-    return entry.is_regular_file();
+inline bool is_directory(const Glib::RefPtr<Gio::File>& file) {
+    return file->query_file_type() == Gio::FILE_TYPE_DIRECTORY;
 }
-inline auto desktop_id(const Glib::RefPtr<Gio::File>& file, const Glib::RefPtr<Gio::File>& dir) {
-    return dir->get_relative_path(file);
+// desktop file id: the path relative to the applications directory, with '/' replaced by '-'
+inline std::string desktop_id(std::string relative_path) {
+    std::replace(relative_path.begin(), relative_path.end(), '/', '-');
+    return relative_path;
 }
-inline auto desktop_id(const fs::path& file, const fs::path& dir) {
-    return file.lexically_relative(dir);
+inline std::string desktop_id(const Glib::RefPtr<Gio::File>& file, const Glib::RefPtr<Gio::File>& dir) {
+    return desktop_id(dir->get_relative_path(file));
 }
 
+/* Walks the directory tree under `dir` (relative to `rel`) through directory fds,
+ * so that no file costs the resolution of its full path.
+ * Calls on_dir(rel) for each subdirectory and on_file(rel, dir_fd, name) for each .desktop file
+ * which is regular or of unknown type, `rel` being the path relative to the walked root; `rel` passed
+ * to walk() is its prefix, so it should be empty or end with '/'. Only symlinks and entries of unknown
+ * type are stat'ed. `dir_fd` of the file's directory stays open until the walker is destroyed.
+ * Directories reachable twice within one walk (via symlinks) are walked once. */
+struct DirWalker {
+    std::set<std::pair<dev_t, ino_t>> visited;
+    std::vector<int>                  dir_fds; // kept for on_file callers
+
+    DirWalker() = default;
+    DirWalker(const DirWalker&) = delete;
+    ~DirWalker() {
+        for (auto fd: dir_fds) {
+            ::close(fd);
+        }
+    }
+    template <typename D, typename F>
+    void walk(const std::string& dir, std::string rel, D && on_dir, F && on_file) {
+        visited.clear();
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0 && enter_(fd)) {
+            walk_(fd, rel, on_dir, on_file);
+        }
+    }
+private:
+    // returns false and closes `fd` if the directory was walked already
+    bool enter_(int fd) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !visited.emplace(st.st_dev, st.st_ino).second) {
+            ::close(fd);
+            return false;
+        }
+        return true;
+    }
+    // takes the ownership of `fd`
+    template <typename D, typename F>
+    void walk_(int fd, std::string& rel, D& on_dir, F& on_file) {
+        auto* dir = ::fdopendir(fd);
+        if (!dir) {
+            ::close(fd);
+            return;
+        }
+        int kept_fd = -1;
+        while (auto* dirent = ::readdir(dir)) {
+            std::string_view name{ dirent->d_name };
+            if (name == "." || name == "..") {
+                continue;
+            }
+            auto type = dirent->d_type;
+            bool is_desktop = looks_like_desktop_file(name);
+            if (type != DT_DIR && type != DT_UNKNOWN && type != DT_LNK && !(type == DT_REG && is_desktop)) {
+                continue;
+            }
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                // follows symlinks
+                struct stat st;
+                if (::fstatat(::dirfd(dir), dirent->d_name, &st, 0) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            auto rel_size = rel.size();
+            rel += name;
+            if (type == DT_DIR) {
+                int sub_fd = ::openat(::dirfd(dir), dirent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (sub_fd >= 0 && enter_(sub_fd)) {
+                    on_dir(rel);
+                    rel.push_back('/');
+                    walk_(sub_fd, rel, on_dir, on_file);
+                }
+            } else if (type == DT_REG && is_desktop) {
+                if (kept_fd < 0) {
+                    kept_fd = dir_fds.emplace_back(::dup(::dirfd(dir)));
+                }
+                if (kept_fd >= 0) {
+                    on_file(rel, kept_fd, dirent->d_name);
+                }
+            }
+            rel.resize(rel_size);
+        }
+        ::closedir(dir);
+    }
+};
+
 EntriesManager::EntriesManager(Span<fs::path> dirs, EntriesModel& table, GridConfig& config):
     table{ table }, config{ config }, desktop_entry_config{ config }
 {
-    // set monitors
-    monitors.reserve(dirs.size());
-    for (auto && dir: dirs) {
-        auto dir_index = monitors.size();
-        auto monitored_dir = Gio::File::create_for_path(dir);
-        auto && monitor = monitors.emplace_back(monitored_dir->monitor_directory());
-        // dir_index and monitored_dir are captured by value
-        // TODO: should I disconnect on exit to make sure there is no dangling reference to `this`?
-        monitor->signal_changed().connect([this,monitored_dir,dir_index](auto && file1, auto && file2, auto event) {
-            (void)file2; // silence warning
-            if (looks_like_desktop_file(file1)) {
-                auto && id = desktop_id(file1, monitored_dir);
-                switch (event) {
-                    // ignored in favor of CHANGES_DONE_HINT
-                    case Gio::FILE_MONITOR_EVENT_CHANGED: break;
-                    case Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
-                        if (can_be_loaded(file1)) {
-                            on_file_changed(id, file1, dir_index);
-                        }
-                        break;
-                    case Gio::FILE_MONITOR_EVENT_DELETED:
-                        on_file_deleted(id, dir_index);
-                        break;
-                        // ignore because CREATED is emitted when the file is created but not written to
-                        // copying/moving emit two signals: CREATED and then CHANGED
-                    case Gio::FILE_MONITOR_EVENT_CREATED:
-                        // TODO: it seems we can safely ignored but I guess we should doublecheck
-                    case Gio::FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED: break;
-                                          // TODO: should we set WATCH_MOVES?
-                                          // we don't set WATCH_MOVES so these three should not be emitted
-                    case Gio::FILE_MONITOR_EVENT_RENAMED:
-                    case Gio::FILE_MONITOR_EVENT_MOVED_IN:
-                    case Gio::FILE_MONITOR_EVENT_MOVED_OUT: Log::warn("WATCH_MOVES flag is set but not handled"); break;
-                                          // we don't set SEND_MOVED (deprecated)
-                    case Gio::FILE_MONITOR_EVENT_MOVED: Log::warn("SEND_MOVED flag is deprecated and thus shouldn't be used"); break;
-                                          // TODO: handle unmounting, e.g. for all files in directory when pre-unmounting erase their entries
-                    case Gio::FILE_MONITOR_EVENT_PRE_UNMOUNT:
-                    case Gio::FILE_MONITOR_EVENT_UNMOUNTED: Log::warn("Unmounting is not supported yet"); break;
-                                          // no default statement so we could see a compiler warning if new flag is added in the future
-                };
-            }
-        });
+    // TryExec lookups are only valid until programs are (un)installed
+    for (auto && dir: executables.dirs()) {
+        try {
+            auto && monitor = path_monitors.emplace_back(Gio::File::create_for_path(dir)->monitor_directory());
+            monitor->signal_changed().connect([this](auto &&, auto &&, auto event) {
+                if (event == Gio::FILE_MONITOR_EVENT_CREATED
+                    || event == Gio::FILE_MONITOR_EVENT_DELETED
+                    || event == Gio::FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED) {
+                    on_path_changed_();
+                }
+            });
+        } catch (const Glib::Error& e) {
+            Log::warn("Failed to monitor PATH directory '", dir, "': ", e.what());
+        }
     }
+    // previously parsed entries
+    DesktopIndex index{ config.index_file, index_fingerprint(config) };
+
+    // walk directories recursively, registering ids in the order of directories, so that overriding rules hold
     // dir_index is used as priority
-    std::size_t dir_index{ 0 };
+    std::vector<LoadJob> jobs;
+    // keeps directories open until the files are parsed
+    DirWalker walker;
+    int dir_index{ 0 };
     for (auto && dir: dirs) {
-        std::error_code ec;
-        // TODO: shouldn't it be recursive_directory_iterator?
-        fs::directory_iterator dir_iter{ dir, ec };
-        for (auto& entry : dir_iter) {
-            if (ec) {
-                Log::error(ec.message());
-                ec.clear();
+        auto root = Gio::File::create_for_path(dir);
+        watch_dir_(dir, root, dir_index);
+        walker.walk(
+            dir.native(),
+            {},
+            [&](const std::string& rel) { watch_dir_(dir / rel, root, dir_index); },
+            [&](const std::string& rel, int dir_fd, const char* name) {
+                auto && id = desktop_id(rel);
+                auto path = dir / rel;
+                if (auto* info = register_id_(id, path, dir_index)) {
+                    auto name_at = path.native().size() - std::strlen(name);
+                    jobs.push_back(LoadJob{ info, std::move(path), dir_fd, name_at });
+                } else {
+                    Log::info(".desktop file '", path, "' with id '", id, "' overridden, ignored");
+                }
+            }
+        );
+        ++dir_index;
+    }
+
+    // parse files on worker threads; GTK and the table are only touched afterwards
+    parallel_for(jobs.size(), [&](std::size_t i) {
+        auto && job = jobs[i];
+        auto* name = job.path.c_str() + job.name_at;
+        if (::fstatat(job.dir_fd, name, &job.st, 0) != 0) {
+            return;
+        }
+        if (auto* record = index.find(job.path, job.st)) {
+            job.cached = true;
+            job.state = record->state;
+            if (record->state == DesktopIndex::Ok) {
+                job.entry.reset(new DesktopEntry{ record->entry });
+            }
+            return;
+        }
+        std::tie(job.state, job.entry) = parse_entry(job.dir_fd, name, desktop_entry_config);
+    });
+
+    table.begin_bulk();
+    for (auto && job: jobs) {
+        if (job.cached) {
+            index.keep(job.path);
+        } else {
+            index.store(job.path, job.st, job.state, job.entry.get());
+        }
+        // the index keeps entries with missing TryExec, as the program may be installed later
+        auto state = check_try_exec_(std::string{ job.info->first }, job.state, job.entry, job.path);
+        insert_entry_(*job.info, state, std::move(job.entry), job.path);
+    }
+    table.end_bulk();
+    table.window.invalidate_search();
+    index.save();
+    Log::info("Desktop ids: ", desktop_ids.size(), " registered, ~", desktop_ids.memory_usage(), " bytes used; ",
+        monitors.size(), " directories watched");
+    // actions are only searched for, so there is no need to parse them until the user types something
+    search_changed = table.window.signal_search.connect([this](const Glib::ustring& criteria) {
+        if (criteria.empty()) {
+            return;
+        }
+        this->table.box_matching_actions(criteria);
+        if (!this->table.pending_actions.empty() && !actions_idle.connected()) {
+            actions_idle = Glib::signal_idle().connect(sigc::mem_fun(*this, &EntriesManager::load_actions_));
+        }
+    });
+}
+
+void EntriesManager::watch_dir_(const fs::path& dir, const Glib::RefPtr<Gio::File>& root, int priority) {
+    // the directory may be reachable from several roots, the first (i.e. with the highest priority) wins
+    auto [slot, inserted] = monitors.try_emplace(dir.native());
+    if (!inserted) {
+        return;
+    }
+    Glib::RefPtr<Gio::FileMonitor> monitor;
+    try {
+        monitor = Gio::File::create_for_path(dir)->monitor_directory();
+    } catch (const Glib::Error& e) {
+        Log::warn("Failed to monitor directory '", dir, "': ", e.what());
+        monitors.erase(slot);
+        return;
+    }
+    slot->second = monitor;
+    // root and priority are captured by value
+    monitor->signal_changed().connect([this,root,priority](auto && file1, auto && file2, auto event) {
+        (void)file2; // silence warning
+        if (!looks_like_desktop_file(file1)) {
+            switch (event) {
+                case Gio::FILE_MONITOR_EVENT_CREATED:
+                    if (is_directory(file1)) {
+                        add_dir_(file1->get_path(), root, priority);
+                    }
+                    break;
+                case Gio::FILE_MONITOR_EVENT_DELETED:
+                    remove_dir_(file1->get_path());
+                    break;
+                default: break;
+            }
+            return;
+        }
+        auto && id = desktop_id(file1, root);
+        switch (event) {
+            // ignored in favor of CHANGES_DONE_HINT
+            case Gio::FILE_MONITOR_EVENT_CHANGED: break;
+            case Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+                if (can_be_loaded(file1)) {
+                    queue_event_(id, file1, priority);
+                }
+                break;
+            case Gio::FILE_MONITOR_EVENT_DELETED:
+                queue_event_(id, {}, priority);
+                break;
+                // ignore because CREATED is emitted when the file is created but not written to
+                // copying/moving emit two signals: CREATED and then CHANGED
+            case Gio::FILE_MONITOR_EVENT_CREATED:
+                // TODO: it seems we can safely ignored but I guess we should doublecheck
+            case Gio::FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED: break;
+                                  // TODO: should we set WATCH_MOVES?
+                                  // we don't set WATCH_MOVES so these three should not be emitted
+            case Gio::FILE_MONITOR_EVENT_RENAMED:
+            case Gio::FILE_MONITOR_EVENT_MOVED_IN:
+            case Gio::FILE_MONITOR_EVENT_MOVED_OUT: Log::warn("WATCH_MOVES flag is set but not handled"); break;
+                                  // we don't set SEND_MOVED (deprecated)
+            case Gio::FILE_MONITOR_EVENT_MOVED: Log::warn("SEND_MOVED flag is deprecated and thus shouldn't be used"); break;
+                                  // TODO: handle unmounting, e.g. for all files in directory when pre-unmounting erase their entries
+            case Gio::FILE_MONITOR_EVENT_PRE_UNMOUNT:
+            case Gio::FILE_MONITOR_EVENT_UNMOUNTED: Log::warn("Unmounting is not supported yet"); break;
+                                  // no default statement so we could see a compiler warning if new flag is added in the future
+        };
+    });
+}
+
+void EntriesManager::add_dir_(const fs::path& dir, const Glib::RefPtr<Gio::File>& root, int priority) {
+    if (monitors.count(dir.native())) {
+        return;
+    }
+    watch_dir_(dir, root, priority);
+    // files might have been put there before the monitor was set
+    auto dir_rel = root->get_relative_path(Gio::File::create_for_path(dir));
+    DirWalker walker;
+    walker.walk(
+        dir.native(),
+        dir_rel + '/',
+        [&](const std::string& rel) { watch_dir_(fs::path{ root->get_path() } / rel, root, priority); },
+        [&](const std::string& rel, int, const char*) {
+            auto path = fs::path{ root->get_path() } / rel;
+            queue_event_(desktop_id(rel), Gio::File::create_for_path(path.native()), priority);
+        }
+    );
+}
+
+void EntriesManager::remove_dir_(const fs::path& dir) {
+    // most deleted paths are plain files, e.g. mimeinfo.cache rewritten on each install
+    auto && prefix = dir.native();
+    if (!monitors.count(prefix)) {
+        return;
+    }
+    // the directory and all its subdirectories
+    auto is_under = [&prefix](const std::string& path) {
+        return path.compare(0, prefix.size(), prefix) == 0 && (path.size() == prefix.size() || path[prefix.size()] == '/');
+    };
+    // cancelled monitors may not report the files deleted
+    for (auto && [id, meta]: desktop_ids) {
+        if (is_under(*meta.dir)) {
+            queue_event_(std::string{ id }, {}, meta.priority);
+        }
+    }
+    for (auto iter = monitors.begin(); iter != monitors.end();) {
+        auto && path = iter->first;
+        if (is_under(path)) {
+            iter->second->cancel();
+            iter = monitors.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+EntriesManager::~EntriesManager() {
+    pending_events_idle.disconnect();
+    search_changed.disconnect();
+    actions_idle.disconnect();
+    path_changed_idle.disconnect();
+}
+
+DesktopIndex::State EntriesManager::check_try_exec_(const std::string& id, DesktopIndex::State state, std::unique_ptr<DesktopEntry>& entry, const fs::path& file) {
+    if (state != DesktopIndex::Ok || entry->try_exec.empty()) {
+        try_exec_files.erase(id);
+        return state;
+    }
+    auto && info = try_exec_files[id];
+    info.file = file;
+    info.hidden.reset();
+    if (can_try_exec(*entry, executables)) {
+        return state;
+    }
+    info.hidden = std::move(entry);
+    return DesktopIndex::Hidden;
+}
+
+void EntriesManager::on_path_changed_() {
+    // installing a package changes many files at once, handle them together
+    if (path_changed_idle.connected()) {
+        return;
+    }
+    path_changed_idle = Glib::signal_idle().connect([this]() {
+        executables.clear();
+        std::size_t flipped{ 0 };
+        table.begin_bulk();
+        for (auto && [id, info]: try_exec_files) {
+            auto* result = desktop_ids.find(id);
+            if (!result) {
+                continue;
+            }
+            auto && meta = result->second;
+            bool shown = !info.hidden;
+            auto && entry = shown ? meta.index->desktop_entry() : *info.hidden;
+            if (can_try_exec(entry, executables) == shown) {
                 continue;
             }
-            if (looks_like_desktop_file(entry) && can_be_loaded(entry)) {
-                auto && path = entry.path();
-                auto && id = desktop_id(path, dir);
-                try_load_entry_(id, path, dir_index);
+            // only the verdict changed, the file is the same
+            if (shown) {
+                info.hidden = table.erase_entry(meta.index);
+                meta.state = Metadata::Hidden;
+            } else {
+                meta.index = table.emplace_entry(result->first, Stats{}, std::move(info.hidden));
+                meta.state = Metadata::Ok;
+                defer_actions_(meta.index, info.file);
             }
+            ++flipped;
         }
-        ++dir_index;
+        table.end_bulk();
+        table.window.invalidate_search();
+        Log::info("PATH changed, ", flipped, " entries shown or hidden by TryExec");
+        return false;
+    });
+}
+
+void EntriesManager::defer_actions_(EntriesModel::Index index, const fs::path& file) {
+    auto && entry = *index;
+    if (!entry.desktop_entry().actions.empty()) {
+        table.pending_actions.insert_or_assign(&entry, file);
     }
 }
 
-// tries to load & insert entry with `id` from `file`
-void EntriesManager::try_load_entry_(std::string id, const fs::path& file, int priority) {
-    // node with id
-    std::list<std::string> id_node;
-    // desktop_ids_store stores string_views.
-    // If we just insert id, there will be dangling reference when id is freed.
-    // To avoid this, we store id in the node and then take a view of it.
-    auto && id_ = id_node.emplace_front(std::move(id));
-
-    auto [iter, inserted] = desktop_ids_info.try_emplace(
-        id_,
+bool EntriesManager::load_actions_() {
+    // files parsed per idle call, so that typing is not blocked
+    constexpr std::size_t BATCH_SIZE = 16;
+    auto && pending = table.pending_actions;
+    for (std::size_t n = 0; n < BATCH_SIZE && !pending.empty(); ++n) {
+        auto iter = pending.begin();
+        auto && [entry, file] = *iter;
+        auto && parent = entry->desktop_entry();
+        // all actions of the entry are in its file, read it once
+        FileContents contents{ file };
+        for (auto offset: parent.actions) {
+            DesktopAction action{};
+            if (contents.ok && parse_desktop_action(contents.data, offset, parent, desktop_entry_config, action)) {
+                table.emplace_action(*entry, action.id, std::make_unique<DesktopEntry>(std::move(action.entry)));
+                ++loaded_actions;
+            } else {
+                Log::warn("Failed to load action at offset ", offset, " of desktop file '", file, "'");
+            }
+        }
+        pending.erase(iter);
+    }
+    // boxes the actions matching the search, filtering once if any of them do
+    table.window.search_again();
+    if (!pending.empty()) {
+        return true;
+    }
+    Log::info("Loaded ", loaded_actions, " desktop actions, ", table.unboxed_actions.size(), " of them without boxes");
+    return false;
+}
+
+void EntriesManager::queue_event_(std::string id, Glib::RefPtr<Gio::File> file, int priority) {
+    auto && events = pending_events[std::move(id)];
+    auto same_dir = [priority](auto && event) { return event.priority == priority; };
+    if (auto iter = std::find_if(events.begin(), events.end(), same_dir); iter != events.end()) {
+        // only the last state of the file matters
+        iter->file = std::move(file);
+        ++merged_events;
+    } else {
+        events.push_back(PendingEvent{ std::move(file), priority });
+    }
+    if (!pending_events_idle.connected()) {
+        pending_events_idle = Glib::signal_idle().connect(
+            sigc::mem_fun(*this, &EntriesManager::apply_events_)
+        );
+    }
+}
+
+bool EntriesManager::apply_events_() {
+    using namespace std::chrono;
+    // keep the main loop responsive if there are too many events
+    constexpr auto budget = milliseconds{ 8 };
+    auto start = steady_clock::now();
+    std::size_t applied{ 0 };
+
+    table.begin_bulk();
+    while (!pending_events.empty() && steady_clock::now() - start < budget) {
+        auto node = pending_events.extract(pending_events.begin());
+        for (auto && event: node.mapped()) {
+            if (event.file) {
+                on_file_changed(node.key(), event.file, event.priority);
+            } else {
+                on_file_deleted(node.key(), event.priority);
+            }
+            ++applied;
+        }
+    }
+    table.end_bulk();
+    table.window.invalidate_search();
+
+    Log::info("Applied ", applied, " file events (", merged_events, " merged so far), ", pending_events.size(), " pending");
+    return !pending_events.empty();
+}
+
+EntriesManager::IdInfo* EntriesManager::register_id_(std::string_view id, const fs::path& file, int priority) {
+    auto [info, inserted] = desktop_ids.try_emplace(
+        id,
         EntriesModel::Index{},
         Metadata::Hidden,
-        priority
+        priority,
+        dir_of_(file)
     );
-    if (inserted) {
-        // the entry was inserted, therefore we need to add the node to the store
-        // to keep the view valid
-        desktop_ids_store.splice(desktop_ids_store.begin(), id_node);
-        // load it
-        try {
-            std::unique_ptr<DesktopEntry> desktop_entry{
-                new DesktopEntry{ parse_desktop_entry(file, desktop_entry_config) }
-            };
-            auto && meta = iter->second;
+    return inserted ? info : nullptr;
+}
+
+const std::string* EntriesManager::dir_of_(const fs::path& file) {
+    return &*dirs.insert(file.parent_path().native()).first;
+}
+
+void EntriesManager::insert_entry_(IdInfo& info, DesktopIndex::State state, std::unique_ptr<DesktopEntry> entry, const fs::path& file) {
+    switch (state) {
+        case DesktopIndex::Ok: {
+            auto && meta = info.second;
             meta.state = Metadata::Ok;
             meta.index = table.emplace_entry(
-                id_,
+                info.first,
                 Stats{},
-                std::move(desktop_entry)
+                std::move(entry)
             );
-        } catch (entry_parse::Hidden) {
-            // do nothing
-        } catch (entry_parse::Error) {
-            Log::error("Failed to load desktop file '", file, "'");
+            defer_actions_(meta.index, file);
+            break;
         }
+        case DesktopIndex::Hidden: break;
+        case DesktopIndex::Invalid:
+            Log::error("Failed to load desktop file '", file, "'");
+            break;
+    }
+}
+
+// tries to load & insert entry with `id` from `file`
+void EntriesManager::try_load_entry_(std::string id, const fs::path& file, int priority) {
+    if (auto* info = register_id_(id, file, priority)) {
+        auto [state, entry] = parse_entry(file, desktop_entry_config);
+        state = check_try_exec_(id, state, entry, file);
+        insert_entry_(*info, state, std::move(entry), file);
     } else {
-        Log::info(".desktop file '", file, "' with id '", id_, "' overridden, ignored");
+        Log::info(".desktop file '", file, "' with id '", id, "' overridden, ignored");
     }
 }
 
 void EntriesManager::on_file_deleted(std::string id, int priority) {
-    if (auto result = desktop_ids_info.find(id); result != desktop_ids_info.end()) {
+    if (auto* result = desktop_ids.find(id)) {
         if (result->second.priority < priority) {
             return;
         }
+        try_exec_files.erase(id);
         if (result->second.state == Metadata::Ok) {
             table.erase_entry(result->second.index);
         }
-        desktop_ids_info.erase(result);
-        auto iter = std::find(desktop_ids_store.begin(), desktop_ids_store.end(), id);
-        desktop_ids_store.erase(iter);
+        desktop_ids.erase(result);
     } else {
         Log::error("on_file_deleted: no entry with id '", id, "'");
     }
@@ -173,48 +651,53 @@ void EntriesManager::on_file_deleted(std::string id, int priority) {
 
 void EntriesManager::on_file_changed(std::string id, const Glib::RefPtr<Gio::File>& file, int priority) {
     auto && path = file->get_path();
-    if (auto result = desktop_ids_info.find(id); result != desktop_ids_info.end()) {
+    if (auto* result = desktop_ids.find(id)) {
         auto && meta = result->second;
         if (meta.priority < priority) {
             // changed file is overridden, no need to do anything
             return;
         }
         meta.priority = priority;
+        meta.dir = dir_of_(path);
 
-        try {
-            std::unique_ptr<DesktopEntry> desktop_entry{
-                new DesktopEntry{ parse_desktop_entry(path, desktop_entry_config) }
-            };
-
-            if (meta.state == Metadata::Ok) {
-                // entry was ok, now ok -> update contents
-                auto new_index = table.update_entry(
-                    result->second.index,
-                    result->first,
-                    Stats{},
-                    std::move(desktop_entry)
-                );
-                result->second.index = new_index;
-            } else {
-                // entry wasn't ok, but now ok -> add it to table it
-                meta.index = table.emplace_entry(
-                    result->first,
-                    Stats{},
-                    std::move(desktop_entry)
-                );
-                meta.state = Metadata::Ok;
-            }
-        } catch (entry_parse::Hidden) {
-            if (meta.state == Metadata::Ok) {
-                table.erase_entry(meta.index);
-            }
-            meta.state = Metadata::Hidden;
-        } catch (entry_parse::Error) {
-            Log::error("Failed to load desktop file'", path, "'");
-            if (meta.state == Metadata::Ok) {
-                table.erase_entry(meta.index);
-            }
-            meta.state = Metadata::Invalid;
+        auto [state, desktop_entry] = parse_entry(path, desktop_entry_config);
+        state = check_try_exec_(id, state, desktop_entry, path);
+        switch (state) {
+            case DesktopIndex::Ok:
+                if (meta.state == Metadata::Ok) {
+                    // entry was ok, now ok -> update contents
+                    auto new_index = table.update_entry(
+                        result->second.index,
+                        result->first,
+                        Stats{},
+                        std::move(desktop_entry)
+                    );
+                    result->second.index = new_index;
+                    defer_actions_(new_index, path);
+                } else {
+                    // entry wasn't ok, but now ok -> add it to table it
+                    meta.index = table.emplace_entry(
+                        result->first,
+                        Stats{},
+                        std::move(desktop_entry)
+                    );
+                    meta.state = Metadata::Ok;
+                    defer_actions_(meta.index, path);
+                }
+                break;
+            case DesktopIndex::Hidden:
+                if (meta.state == Metadata::Ok) {
+                    table.erase_entry(meta.index);
+                }
+                meta.state = Metadata::Hidden;
+                break;
+            case DesktopIndex::Invalid:
+                Log::error("Failed to load desktop file'", path, "'");
+                if (meta.state == Metadata::Ok) {
+                    table.erase_entry(meta.index);
+                }
+                meta.state = Metadata::Invalid;
+                break;
         }
     } else {
         // there was not such entry, add it
@@ -9,21 +9,43 @@
 #pragma once
 
 #include <list>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "nwg_classes.h"
 #include "filesystem-compat.h"
 #include "grid.h"
+#include "grid_ids.h"
+#include "grid_index.h"
+
+/* Resolves programs (TryExec values) through PATH, remembering the results
+ * until clear() is called, e.g. when contents of PATH directories change */
+class ExecutableCache {
+    std::vector<std::string>              path_dirs;
+    std::unordered_map<std::string, bool> found;
+public:
+    ExecutableCache();
+
+    bool find(const std::string& program);
+    void clear() {
+        found.clear();
+    }
+    const auto & dirs() const {
+        return path_dirs;
+    }
+};
 
 /* Stores pre-processed assets useful when parsing DesktopEntry struct */
 struct DesktopEntryConfig {
-    std::string_view term;  // user-preferred terminal
-    std::string name_ln;    // localized prefix: Name[ln]=
-    std::string comment_ln; // localized prefix: Comment[ln]=
+    std::string_view term;       // user-preferred terminal
+    std::string_view lang;       // user-preferred language, as in Name[ln]=
     std::string_view home;
+    // $XDG_CURRENT_DESKTOP, matched against OnlyShowIn & NotShowIn
+    std::vector<std::string> current_desktops;
 
-    const ns::json& config_source;
-    std::vector<std::string_view> known_categories;
+    // known category name -> category id
+    std::unordered_map<std::string_view, std::size_t> category_ids;
 
     DesktopEntryConfig(const GridConfig& config);
 
@@ -39,37 +61,68 @@ struct EntriesModel {
     // TODO: think of saner way to load icons
     IconProvider& icons;
 
-    Span<std::string> pins;
-    Span<CacheEntry>  favs;
+    const StatsIndex& stats_index;
 
     // list because entries should not get invalidated when inserting/erasing
     std::list<Entry> entries;
     using Index = typename decltype(entries)::iterator;
 
-    EntriesModel(GridConfig& config, GridWindow& window, IconProvider& icons, Span<std::string> pins, Span<CacheEntry> favs):
-        config{ config }, window{ window }, icons{ icons }, pins{ pins }, favs{ favs }
+    // set between begin_bulk() and end_bulk()
+    bool bulk{ false };
+
+    EntriesModel(GridConfig& config, GridWindow& window, IconProvider& icons, const StatsIndex& stats_index):
+        config{ config }, window{ window }, icons{ icons }, stats_index{ stats_index }
     {
         // intentionally left blank
     }
 
+    // entries with [Desktop Action] sections not parsed yet -> their files
+    std::unordered_map<Entry*, fs::path> pending_actions;
+    // parsed actions without boxes, which are only made for actions matching a search
+    struct UnboxedAction {
+        Entry*           parent;
+        Entry*           action;
+        SearchTable::Row row;
+    };
+    std::vector<UnboxedAction> unboxed_actions;
+
     template <typename ... Ts>
     Index emplace_entry(Ts && ... args) {
         auto & entry = entries.emplace_front(std::forward<Ts>(args)...);
         set_entry_stats(entry);
-        auto && box = window.emplace_box(
-            entry.desktop_entry().name,
-            entry.desktop_entry().comment,
-            entry
-        );
-        // boxing is necessary
-        // for some reason the icons are not shown if the images are not boxed
-        auto image = Gtk::make_managed<Gtk::Image>(icons.load_icon(entry.desktop_entry().icon));
-        box.set_image(*image);
-        box.set_always_show_image(true);
-        window.build_grids();
+        emplace_box_(entry);
+        if (!bulk) {
+            window.build_grids();
+        }
 
         return entries.begin();
     }
+    // adds entry of the action `id` of `parent`, leaving it without a box, see box_matching_actions
+    void emplace_action(Entry& parent, std::string_view id, std::unique_ptr<DesktopEntry> desktop_entry) {
+        auto && action = parent.actions.emplace_back(std::string_view{}, Stats{}, std::move(desktop_entry));
+        action.action_id = concat(parent.desktop_id, "#", id);
+        action.desktop_id = action.action_id;
+        unboxed_actions.push_back(UnboxedAction{ &parent, &action, window.search_row(action) });
+    }
+    /* Makes boxes for the unboxed actions matching `criteria`, if it is not empty.
+     * Called by the filter pass before it filters the view, so the grids are not rebuilt here,
+     * and the new boxes are shown by filtering alone */
+    void box_matching_actions(const Glib::ustring& criteria) {
+        auto query = window.search_query_of(criteria);
+        if (query.text.empty()) {
+            return;
+        }
+        for (std::size_t i = 0; i < unboxed_actions.size();) {
+            auto && unboxed = unboxed_actions[i];
+            if (!SearchTable::matches(unboxed.row, query)) {
+                ++i;
+                continue;
+            }
+            emplace_box_(*unboxed.action).show_all();
+            unboxed = std::move(unboxed_actions.back());
+            unboxed_actions.pop_back();
+        }
+    }
     template <typename ... Ts>
     Index update_entry(Index index, Ts && ... args) {
         // TODO: merge entries
@@ -79,11 +132,12 @@ struct EntriesModel {
 
         decltype(entries) preserve;
         preserve.splice(index, entries);
+        erase_actions_(*index);
 
-        set_entry_stats(entry);
+        // keep pins & launch history gathered at runtime
+        entry.stats = index->stats;
         GridBox new_box {
             entry.desktop_entry().name,
-            entry.desktop_entry().comment,
             entry
         };
         // boxing is necessary
@@ -94,27 +148,63 @@ struct EntriesModel {
 
         return new_index;
     }
-    void erase_entry(Index index) {
+    // returns the erased DesktopEntry, so that it can be inserted again without parsing
+    std::unique_ptr<DesktopEntry> erase_entry(Index index) {
         auto && entry = *index;
+        erase_actions_(entry);
         window.remove_box_by_desktop_id(entry.desktop_id);
+        auto desktop_entry = std::move(entry.desktop_entry_);
         entries.erase(index);
-        window.build_grids();
+        if (!bulk) {
+            window.build_grids();
+        }
+        return desktop_entry;
+    }
+    /* Bulk loading: entries emplaced until end_bulk() are sorted into the models
+     * and announced at once, and the grids are rebuilt only once */
+    void begin_bulk() {
+        bulk = true;
+        window.begin_bulk();
+    }
+    void end_bulk() {
+        bulk = false;
+        window.end_bulk();
     }
     auto & row(Index index) {
         return *index;
     }
 private:
-    void set_entry_stats(Entry& entry) {
-        if (auto result = std::find(pins.begin(), pins.end(), entry.desktop_id); result != pins.end()) {
-            entry.stats.pinned = Stats::Pinned;
-            // temporary fix for #176
-            // see comments to PinnedBoxes class
-            entry.stats.position = (result - pins.begin()) - pins.size() - 1;
+    GridBox& emplace_box_(Entry& entry) {
+        auto && box = window.emplace_box(
+            entry.desktop_entry().name,
+            entry
+        );
+        // boxing is necessary
+        // for some reason the icons are not shown if the images are not boxed
+        auto image = Gtk::make_managed<Gtk::Image>(icons.load_icon(entry.desktop_entry().icon));
+        box.set_image(*image);
+        box.set_always_show_image(true);
+        return box;
+    }
+    void erase_actions_(Entry& entry) {
+        pending_actions.erase(&entry);
+        auto of_entry = [&entry](auto && unboxed) { return unboxed.parent == &entry; };
+        unboxed_actions.erase(std::remove_if(unboxed_actions.begin(), unboxed_actions.end(), of_entry), unboxed_actions.end());
+        for (auto && action: entry.actions) {
+            window.remove_box_by_desktop_id(action.desktop_id);
         }
-        auto cmp = [&entry](auto && fav){ return entry.desktop_id == fav.desktop_id; };
-        if (auto result = std::find_if(favs.begin(), favs.end(), cmp); result != favs.end()) {
-            entry.stats.favorite = Stats::Favorite;
-            entry.stats.clicks = result->clicks;
+    }
+    void set_entry_stats(Entry& entry) {
+        if (auto result = stats_index.find(entry.desktop_id); result != stats_index.end()) {
+            auto && stats = result->second;
+            if (stats.pinned) {
+                entry.stats.pinned = Stats::Pinned;
+                entry.stats.position = stats.position;
+            }
+            entry.stats.favorite = stats.favorite;
+            entry.stats.clicks = stats.clicks;
+            entry.stats.rank = stats.rank;
+            entry.stats.last_launch = stats.last_launch;
         }
     }
 };
@@ -134,36 +224,90 @@ struct EntriesManager {
             Invalid,
             Hidden
         };
-        Index     index;    // index in table; index is invalid if state is not Ok
-        FileState state;
-        int       priority; // the lower the value, the bigger the priority
-                            // i.e. if file1.priority > file2.priority, the file2 wins
+        Index              index;    // index in table; index is invalid if state is not Ok
+        FileState          state;
+        int                priority; // the lower the value, the bigger the priority
+                                     // i.e. if file1.priority > file2.priority, the file2 wins
+        const std::string* dir;      // directory of the file, see EntriesManager::dirs
 
-        Metadata(Index index, FileState state, int priority):
-            index{ index }, state{ state }, priority{ priority }
+        Metadata(Index index, FileState state, int priority, const std::string* dir):
+            index{ index }, state{ state }, priority{ priority }, dir{ dir }
         {
             // intentionally left blank
         }
     };
 
-    // stores "desktop id"s
-    // list because insertions/removals should not invalidate the store
-    std::list<std::string>                         desktop_ids_store;
-    // maps "desktop id" to Metadata
-    std::unordered_map<std::string_view, Metadata> desktop_ids_info;
-    // stored monitors
-    // just to keep them alive
-    std::vector<Glib::RefPtr<Gio::FileMonitor>>    monitors;
+    // maps "desktop id" to Metadata, owns the ids
+    IdRegistry<Metadata>                           desktop_ids;
+    // monitors of application directories & their subdirectories, by path
+    std::unordered_map<std::string, Glib::RefPtr<Gio::FileMonitor>> monitors;
+    // paths of directories files were loaded from, never erased so that Metadata::dir stays valid
+    std::unordered_set<std::string> dirs;
+
+    // monitor event waiting to be applied
+    struct PendingEvent {
+        Glib::RefPtr<Gio::File> file; // empty if the file was deleted
+        int                     priority;
+    };
+    // pending events, at most one per desktop id & directory
+    std::unordered_map<std::string, std::vector<PendingEvent>> pending_events;
+    // number of events merged into already pending ones
+    std::size_t      merged_events{ 0 };
+    sigc::connection pending_events_idle;
+    // loads pending actions once the user starts searching
+    sigc::connection search_changed;
+    sigc::connection actions_idle;
+    std::size_t      loaded_actions{ 0 };
+    sigc::connection path_changed_idle;
+
+    // TryExec lookups shared by all entries, and monitors of PATH directories invalidating them
+    ExecutableCache                             executables;
+    std::vector<Glib::RefPtr<Gio::FileMonitor>> path_monitors;
+    // files with TryExec, to be re-checked when PATH directories change
+    struct TryExecFile {
+        fs::path                      file;
+        std::unique_ptr<DesktopEntry> hidden; // the parsed entry while TryExec is missing, null if shown
+    };
+    std::unordered_map<std::string, TryExecFile> try_exec_files;
 
     EntriesModel& table;
     GridConfig&   config;
 
     DesktopEntryConfig desktop_entry_config;
 
+    using IdInfo = decltype(desktop_ids)::value_type;
+
     EntriesManager(Span<fs::path> dirs, EntriesModel& table, GridConfig& config);
+    ~EntriesManager();
     void on_file_changed(std::string id, const Glib::RefPtr<Gio::File>& file, int priority);
     void on_file_deleted(std::string id, int priority);
 private:
+    // stores `id` of `file` with `priority`; returns nullptr if `id` is already taken
+    IdInfo* register_id_(std::string_view id, const fs::path& file, int priority);
+    // returns the stored path of the directory of `file`
+    const std::string* dir_of_(const fs::path& file);
+    // inserts loaded entry into the table
+    void insert_entry_(IdInfo& info, DesktopIndex::State state, std::unique_ptr<DesktopEntry> entry, const fs::path& file);
     // tries to load & insert entry with `id` from `file`
     void try_load_entry_(std::string id, const fs::path& file, int priority);
+    // sets a monitor on `dir`, which is `root` or its subdirectory; ids are relative to `root`
+    void watch_dir_(const fs::path& dir, const Glib::RefPtr<Gio::File>& root, int priority);
+    // watches the new subdirectory `dir` & its subdirectories, queueing their files to be loaded
+    void add_dir_(const fs::path& dir, const Glib::RefPtr<Gio::File>& root, int priority);
+    // stops watching `dir` & its subdirectories, queueing deletion of the files loaded from them
+    void remove_dir_(const fs::path& dir);
+    // queues monitor event to be applied later in one batch
+    void queue_event_(std::string id, Glib::RefPtr<Gio::File> file, int priority);
+    // idle callback applying pending events, returns true if some are left
+    bool apply_events_();
+    /* Turns Ok `state` into Hidden if TryExec of `entry` is missing, remembering the file to re-check it later;
+     * the entry of a hidden file is kept there, so that it can be shown without parsing the file again */
+    DesktopIndex::State check_try_exec_(const std::string& id, DesktopIndex::State state, std::unique_ptr<DesktopEntry>& entry, const fs::path& file);
+    // drops TryExec lookups & shows or hides the entries whose TryExec (dis)appeared
+    void on_path_changed_();
+    // remembers to parse actions of `index` from `file` later, see load_actions_
+    void defer_actions_(EntriesModel::Index index, const fs::path& file);
+    /* Idle callback parsing [Desktop Action] sections of a batch of pending entries,
+     * boxing the parsed actions which match the search; returns true if some are left */
+    bool load_actions_();
 };
@@ -0,0 +1,107 @@
+/* GTK-based application grid
+ * Copyright (c) 2021 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* Binary heap which knows the position of each element,
+ * so that elements can be erased or re-prioritized in O(log n).
+ * Like std::priority_queue, top() is the greatest element according to Compare.
+ * Elements must be unique. */
+template <typename T, typename Compare>
+class IndexedHeap {
+    std::vector<T>                     items;
+    std::unordered_map<T, std::size_t> positions;
+    Compare                            less;
+
+    void swap_(std::size_t a, std::size_t b) {
+        std::swap(items[a], items[b]);
+        positions[items[a]] = a;
+        positions[items[b]] = b;
+    }
+    std::size_t sift_up_(std::size_t i) {
+        while (i > 0) {
+            auto parent = (i - 1) / 2;
+            if (!less(items[parent], items[i])) {
+                break;
+            }
+            swap_(i, parent);
+            i = parent;
+        }
+        return i;
+    }
+    void sift_down_(std::size_t i) {
+        for (;;) {
+            auto largest = i;
+            for (auto child: { 2 * i + 1, 2 * i + 2 }) {
+                if (child < items.size() && less(items[largest], items[child])) {
+                    largest = child;
+                }
+            }
+            if (largest == i) {
+                break;
+            }
+            swap_(i, largest);
+            i = largest;
+        }
+    }
+public:
+    IndexedHeap(Compare less = Compare{}): less{ std::move(less) } {}
+
+    bool empty() const { return items.empty(); }
+    std::size_t size() const { return items.size(); }
+    const T& top() const { return items.front(); }
+    bool contains(const T& item) const { return positions.count(item); }
+
+    void push(T item) {
+        positions[item] = items.size();
+        items.push_back(std::move(item));
+        sift_up_(items.size() - 1);
+    }
+    void erase(const T& item) {
+        auto iter = positions.find(item);
+        if (iter == positions.end()) {
+            return;
+        }
+        auto i = iter->second;
+        positions.erase(iter);
+        auto last = items.size() - 1;
+        if (i != last) {
+            items[i] = std::move(items[last]);
+            positions[items[i]] = i;
+        }
+        items.pop_back();
+        if (i != last) {
+            update_at_(i);
+        }
+    }
+    // restores the heap after the priority of `item` changed
+    void update(const T& item) {
+        if (auto iter = positions.find(item); iter != positions.end()) {
+            update_at_(iter->second);
+        }
+    }
+    // puts `to` in place of `from`, both having the same priority
+    void replace(const T& from, T to) {
+        if (auto iter = positions.find(from); iter != positions.end()) {
+            auto i = iter->second;
+            positions.erase(iter);
+            positions[to] = i;
+            items[i] = std::move(to);
+        }
+    }
+private:
+    void update_at_(std::size_t i) {
+        if (sift_up_(i) == i) {
+            sift_down_(i);
+        }
+    }
+};
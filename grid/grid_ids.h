@@ -0,0 +1,103 @@
+/* GTK-based application grid
+ * Copyright (c) 2021 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/* Maps desktop ids to values of type T.
+ * Ids are interned in a string arena made of fixed-size blocks which never move,
+ * so the keys (views into the arena) stay valid for the lifetime of the registry.
+ * Slots of erased ids are reused by new ids of the same length.
+ * Insertion, lookup and erasure take O(1) on average. */
+template <typename T>
+class IdRegistry {
+    static constexpr std::size_t BLOCK_SIZE = 16 * 1024;
+
+    std::vector<std::unique_ptr<char[]>>                blocks;
+    std::size_t                                         block_used{ BLOCK_SIZE }; // bytes used in blocks.back()
+    std::size_t                                         arena_size{ 0 };          // bytes allocated for blocks
+    std::unordered_map<std::size_t, std::vector<char*>> free_slots;               // length -> erased slots
+    std::unordered_map<std::string_view, T>             map;
+
+    // copies `id` into the arena, returns view of the copy
+    std::string_view intern_(std::string_view id) {
+        auto size = id.size();
+        char* slot = nullptr;
+        if (auto iter = free_slots.find(size); iter != free_slots.end() && !iter->second.empty()) {
+            slot = iter->second.back();
+            iter->second.pop_back();
+        } else if (size > BLOCK_SIZE / 4) {
+            // too long to waste the block remainder on it, give it its own block
+            // and keep filling the current one
+            auto && block = blocks.emplace(blocks.end() - !blocks.empty(), new char[size]);
+            arena_size += size;
+            slot = block->get();
+        } else {
+            if (block_used + size > BLOCK_SIZE) {
+                blocks.emplace_back(new char[BLOCK_SIZE]);
+                arena_size += BLOCK_SIZE;
+                block_used = 0;
+            }
+            slot = blocks.back().get() + block_used;
+            block_used += size;
+        }
+        std::memcpy(slot, id.data(), size);
+        return { slot, size };
+    }
+public:
+    using value_type = typename decltype(map)::value_type;
+
+    IdRegistry() = default;
+    IdRegistry(const IdRegistry&) = delete;
+
+    // returns pointer to the stored pair or nullptr if there is no such id
+    value_type* find(std::string_view id) {
+        if (auto iter = map.find(id); iter != map.end()) {
+            return &*iter;
+        }
+        return nullptr;
+    }
+    // inserts `id` with value constructed from `args` unless it's already present;
+    // returns pointer to the stored pair and whether the insertion took place
+    template <typename ... Args>
+    std::pair<value_type*, bool> try_emplace(std::string_view id, Args && ... args) {
+        if (auto* found = find(id)) {
+            return { found, false };
+        }
+        auto [iter, _] = map.try_emplace(intern_(id), std::forward<Args>(args)...);
+        return { &*iter, true };
+    }
+    void erase(value_type* pair) {
+        auto key = pair->first;
+        map.erase(key);
+        // the arena memory is only ever reused for ids of the same length
+        free_slots[key.size()].push_back(const_cast<char*>(key.data()));
+    }
+    std::size_t size() const {
+        return map.size();
+    }
+    auto begin() { return map.begin(); }
+    auto end() { return map.end(); }
+    // approximate number of bytes used by the registry
+    std::size_t memory_usage() const {
+        constexpr auto node_size = sizeof(value_type) + 2 * sizeof(void*); // value + next pointer + hash
+        auto usage = arena_size
+            + blocks.capacity() * sizeof(blocks[0])
+            + map.bucket_count() * sizeof(void*)
+            + map.size() * node_size;
+        for (auto && [_, slots]: free_slots) {
+            usage += node_size + slots.capacity() * sizeof(char*);
+        }
+        return usage;
+    }
+};
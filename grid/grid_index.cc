@@ -0,0 +1,240 @@
+/* GTK-based application grid
+ * Copyright (c) 2021 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <cstring>
+#include <fstream>
+
+#include "nwg_tools.h"
+#include "grid_index.h"
+#include "log.h"
+
+namespace {
+
+// bump each time the layout of the index or DesktopEntry changes
+constexpr std::uint32_t INDEX_VERSION = 7;
+constexpr std::string_view INDEX_MAGIC{ "NWGIDX" };
+
+/* Native-endian writer; the index is a local cache and never leaves the machine */
+struct Writer {
+    std::string buf;
+
+    template <typename T>
+    void pod(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        buf.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void str(std::string_view s) {
+        pod<std::uint32_t>(s.size());
+        buf.append(s.data(), s.size());
+    }
+};
+
+/* Reader over the whole file contents; sets `ok` to false on truncated input */
+struct Reader {
+    std::string_view data;
+    bool ok{ true };
+
+    template <typename T>
+    T pod() {
+        T value{};
+        if (data.size() < sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, data.data(), sizeof(T));
+        data.remove_prefix(sizeof(T));
+        return value;
+    }
+    std::string str() {
+        auto size = pod<std::uint32_t>();
+        if (!ok || data.size() < size) {
+            ok = false;
+            return {};
+        }
+        std::string s{ data.substr(0, size) };
+        data.remove_prefix(size);
+        return s;
+    }
+};
+
+void write_entry(Writer& w, const DesktopEntry& entry) {
+    w.str(entry.name);
+    w.str(entry.generic_name);
+    w.str(entry.keywords);
+    w.str(entry.exec);
+    w.str(entry.try_exec);
+    w.str(entry.icon);
+    w.str(entry.comment);
+    w.pod(entry.categories);
+    w.pod<std::uint32_t>(entry.actions.size());
+    for (auto offset: entry.actions) {
+        w.pod(offset);
+    }
+    w.pod<std::uint8_t>(entry.terminal);
+}
+
+void read_entry(Reader& r, DesktopEntry& entry) {
+    entry.name = r.str();
+    entry.generic_name = r.str();
+    entry.keywords = r.str();
+    entry.exec = r.str();
+    entry.try_exec = r.str();
+    entry.icon = r.str();
+    entry.comment = r.str();
+    entry.categories = r.pod<decltype(entry.categories)>();
+    auto n_actions = r.pod<std::uint32_t>();
+    for (std::uint32_t i = 0; r.ok && i < n_actions; ++i) {
+        entry.actions.push_back(r.pod<std::uint32_t>());
+    }
+    entry.terminal = r.pod<std::uint8_t>();
+}
+
+inline std::int64_t mtime_of(const struct stat& st) {
+    return std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+inline auto split_path(const fs::path& file) {
+    return std::pair{ file.parent_path().native(), file.filename().native() };
+}
+
+} // namespace
+
+DesktopIndex::DesktopIndex(fs::path path, std::string fingerprint):
+    path{ std::move(path) }, fingerprint{ std::move(fingerprint) }
+{
+    load_();
+}
+
+void DesktopIndex::load_() {
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) {
+        return;
+    }
+    auto contents = read_file_to_string(path);
+    Reader r{ contents };
+
+    if (r.data.substr(0, INDEX_MAGIC.size()) != INDEX_MAGIC) {
+        Log::warn("Desktop index '", path, "' is corrupted, ignoring");
+        return;
+    }
+    r.data.remove_prefix(INDEX_MAGIC.size());
+    if (r.pod<std::uint32_t>() != INDEX_VERSION || r.str() != fingerprint || !r.ok) {
+        Log::info("Desktop index '", path, "' is outdated, rebuilding");
+        return;
+    }
+    decltype(loaded) dirs;
+    std::size_t size{ 0 };
+    auto n_dirs = r.pod<std::uint32_t>();
+    for (std::uint32_t i = 0; r.ok && i < n_dirs; ++i) {
+        auto && records = dirs[r.str()];
+        auto n_records = r.pod<std::uint32_t>();
+        for (std::uint32_t j = 0; r.ok && j < n_records; ++j) {
+            auto && record = records[r.str()];
+            record.inode = r.pod<std::uint64_t>();
+            record.mtime = r.pod<std::int64_t>();
+            record.size = r.pod<std::uint64_t>();
+            record.state = State{ r.pod<std::uint8_t>() };
+            if (record.state == Ok) {
+                read_entry(r, record.entry);
+            }
+            ++size;
+        }
+    }
+    if (!r.ok || !r.data.empty()) {
+        Log::warn("Desktop index '", path, "' is corrupted, ignoring");
+        return;
+    }
+    loaded = std::move(dirs);
+    loaded_size = size;
+}
+
+const DesktopIndex::Record* DesktopIndex::find(const fs::path& file, const struct stat& st) const {
+    auto [dir, name] = split_path(file);
+    auto dir_iter = loaded.find(dir);
+    if (dir_iter == loaded.end()) {
+        return nullptr;
+    }
+    auto && records = dir_iter->second;
+    auto iter = records.find(name);
+    if (iter == records.end()) {
+        return nullptr;
+    }
+    auto && record = iter->second;
+    auto up_to_date = record.inode == std::uint64_t(st.st_ino)
+        && record.mtime == mtime_of(st)
+        && record.size == std::uint64_t(st.st_size);
+    return up_to_date ? &record : nullptr;
+}
+
+void DesktopIndex::keep(const fs::path& file) {
+    auto [dir, name] = split_path(file);
+    if (auto dir_iter = loaded.find(dir); dir_iter != loaded.end()) {
+        if (auto node = dir_iter->second.extract(name)) {
+            ++hits;
+            next[dir].insert(std::move(node));
+        }
+    }
+}
+
+void DesktopIndex::store(const fs::path& file, const struct stat& st, State state, const DesktopEntry* entry) {
+    ++misses;
+    auto [dir, name] = split_path(file);
+    auto && record = next[dir][name];
+    record.inode = st.st_ino;
+    record.mtime = mtime_of(st);
+    record.size = st.st_size;
+    record.state = state;
+    if (state == Ok && entry) {
+        record.entry = *entry;
+    } else {
+        record.entry = DesktopEntry{};
+    }
+}
+
+void DesktopIndex::save() {
+    Log::info("Desktop index: ", hits, " hits, ", misses, " misses");
+    // nothing was re-parsed and nothing was removed, the file on disk is up to date
+    if (misses == 0 && hits == loaded_size) {
+        return;
+    }
+    Writer w;
+    w.buf.append(INDEX_MAGIC);
+    w.pod<std::uint32_t>(INDEX_VERSION);
+    w.str(fingerprint);
+    w.pod<std::uint32_t>(next.size());
+    for (auto && [dir, records]: next) {
+        w.str(dir);
+        w.pod<std::uint32_t>(records.size());
+        for (auto && [name, record]: records) {
+            w.str(name);
+            w.pod(record.inode);
+            w.pod(record.mtime);
+            w.pod(record.size);
+            w.pod<std::uint8_t>(record.state);
+            if (record.state == Ok) {
+                write_entry(w, record.entry);
+            }
+        }
+    }
+    // write to a temporary file first so concurrent readers never see partial index
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    auto tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out{ tmp, std::ios::binary | std::ios::trunc };
+        if (!out || !out.write(w.buf.data(), w.buf.size())) {
+            Log::error("Failed to save desktop index to '", tmp, "'");
+            return;
+        }
+    }
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        Log::error("Failed to save desktop index to '", path, "': ", ec.message());
+    }
+}
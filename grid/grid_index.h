@@ -0,0 +1,64 @@
+/* GTK-based application grid
+ * Copyright (c) 2021 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "nwg_classes.h"
+#include "filesystem-compat.h"
+
+/* On-disk index of already parsed .desktop files.
+ * Records are keyed by the directory path and the file name; a record is only reused
+ * if the file's inode, mtime and size did not change since the record was stored.
+ * The whole index is discarded if `fingerprint` (settings affecting parsing: language,
+ * terminal, categories, current desktop) differs from the stored one. */
+struct DesktopIndex {
+    enum State: std::uint8_t {
+        Ok = 0,
+        Invalid,
+        Hidden
+    };
+    struct Record {
+        std::uint64_t inode{ 0 };
+        std::int64_t  mtime{ 0 };   // nanoseconds
+        std::uint64_t size{ 0 };
+        State         state{ Invalid };
+        DesktopEntry  entry{};      // meaningful only if state is Ok
+    };
+    using Records = std::unordered_map<std::string, Record>;
+
+    fs::path    path;
+    std::string fingerprint;
+
+    DesktopIndex(fs::path path, std::string fingerprint);
+    DesktopIndex(const DesktopIndex&) = delete;
+
+    // returns the stored record for `file` if it is still up to date, nullptr otherwise;
+    // does not modify the index and thus can be called from several threads at once
+    const Record* find(const fs::path& file, const struct stat& st) const;
+    // keeps the record of `file` previously returned by `find`
+    void keep(const fs::path& file);
+    // remembers parse result of `file` to be saved
+    void store(const fs::path& file, const struct stat& st, State state, const DesktopEntry* entry);
+    // writes the index to `path` if it has changed
+    void save();
+private:
+    // dir -> file name -> record
+    std::unordered_map<std::string, Records> loaded;
+    std::unordered_map<std::string, Records> next;
+    std::size_t loaded_size{ 0 };
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+
+    void load_();
+};
@@ -0,0 +1,325 @@
+/* GTK-based application grid
+ * Copyright (c) 2021 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+
+#include <glib.h>
+
+#include "grid_search.h"
+
+namespace {
+
+constexpr int SCORE_MATCH                 = 16;
+constexpr int SCORE_GAP_START             = -3;
+constexpr int SCORE_GAP_EXTENSION         = -1;
+constexpr int BONUS_CONSECUTIVE           = 4;
+constexpr int BONUS_FIRST_CHAR_MULTIPLIER = 2;               // the first query character weighs more
+constexpr int BONUS_SCORES[]              = { 0, 7, 8, 10 }; // indexed by SearchBonus
+constexpr int SCORE_FIELDS_MATCH          = 4;               // per byte of query matched in secondary fields
+
+auto free_gchar = [](gchar* p) { g_free(p); };
+using GcharPtr = std::unique_ptr<gchar, decltype(free_gchar)>;
+
+SearchBonus bonus_of(gunichar prev, gunichar c, bool first) {
+    if (first) {
+        return FirstBonus;
+    }
+    if (!g_unichar_isalnum(prev) && g_unichar_isalnum(c)) {
+        return BoundaryBonus;
+    }
+    if ((g_unichar_islower(prev) && g_unichar_isupper(c)) || (!g_unichar_isdigit(prev) && g_unichar_isdigit(c))) {
+        return CamelBonus;
+    }
+    return NoBonus;
+}
+
+// appends casefolded `folded` to `dest`, stripping combining marks (diacritics) if `strip_diacritics` is set
+void append_folded(std::string_view folded, bool strip_diacritics, std::string& dest) {
+    if (!strip_diacritics) {
+        dest += folded;
+        return;
+    }
+    for (const gchar* p = folded.data(), *end = p + folded.size(); p < end; p = g_utf8_next_char(p)) {
+        auto c = g_utf8_get_char(p);
+        if (c < 0x80) {
+            dest.push_back(char(c));
+            continue;
+        }
+        // decompose so that diacritics become separate combining marks, then drop them
+        gunichar decomposed[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
+        auto n = g_unichar_fully_decompose(c, FALSE, decomposed, G_UNICHAR_MAX_DECOMPOSITION_LENGTH);
+        for (gsize i = 0; i < n; ++i) {
+            if (!g_unichar_ismark(decomposed[i])) {
+                gchar buf[6];
+                dest.append(buf, g_unichar_to_utf8(decomposed[i], buf));
+            }
+        }
+    }
+}
+
+// byte length of casefolded `c`; only non-ASCII characters are folded to find it out
+std::size_t folded_length(gunichar c) {
+    if (c < 0x80) {
+        return 1;
+    }
+    gchar buf[6];
+    auto n = g_unichar_to_utf8(c, buf);
+    GcharPtr folded{ g_utf8_casefold(buf, n), free_gchar };
+    return std::strlen(folded.get());
+}
+
+} // namespace
+
+std::string fold_search_key(const Glib::ustring& str, bool strip_diacritics, std::string* bonus) {
+    // casefolding maps characters one by one, so the whole string is folded at once
+    GcharPtr folded_str{ g_utf8_casefold(str.data(), str.bytes()), free_gchar };
+    std::string_view folded{ folded_str.get() };
+    std::string key;
+    key.reserve(folded.size());
+    if (!bonus) {
+        append_folded(folded, strip_diacritics, key);
+        return key;
+    }
+    // bonuses depend on the original characters, so the folded ones are walked along them
+    std::size_t at = 0;
+    gunichar prev = 0;
+    bool first = true;
+    for (auto c: str) {
+        auto length = std::min(folded_length(c), folded.size() - at);
+        auto from = key.size();
+        append_folded(folded.substr(at, length), strip_diacritics, key);
+        at += length;
+        if (key.size() > from) {
+            bonus->push_back(bonus_of(prev, c, first));
+            bonus->append(key.size() - from - 1, NoBonus);
+            first = false;
+        }
+        prev = c;
+    }
+    return key;
+}
+
+SearchQuery::SearchQuery(std::string text): text{ std::move(text) } {
+    mask = search_char_mask(this->text);
+    for (const gchar* p = this->text.data(), *end = p + this->text.size(); p < end;) {
+        auto next = g_utf8_next_char(p);
+        lengths.push_back(next - p);
+        p = next;
+    }
+}
+
+bool SearchTable::matches_name(const Row& row, const SearchQuery& query) {
+    if (query.mask & ~row.chars) {
+        return false;
+    }
+    std::string_view key{ row.key };
+    std::size_t pos = 0, offset = 0;
+    for (auto length: query.lengths) {
+        pos = key.find(std::string_view{ query.text.data() + offset, length }, pos);
+        if (pos == std::string_view::npos) {
+            return false;
+        }
+        pos += length;
+        offset += length;
+    }
+    return true;
+}
+
+int SearchTable::score(const Row& row, const SearchQuery& query) {
+    std::string_view key{ row.key };
+    auto char_at = [&query](std::size_t offset, std::size_t length) {
+        return std::string_view{ query.text.data() + offset, length };
+    };
+    // the leftmost match gives the earliest end of a match
+    std::size_t end = 0;
+    for (std::size_t i = 0, offset = 0; i < query.lengths.size(); offset += query.lengths[i++]) {
+        end = key.find(char_at(offset, query.lengths[i]), end);
+        if (end == std::string_view::npos) {
+            return SCORE_FIELDS_MATCH * int(query.text.size());
+        }
+        end += query.lengths[i];
+    }
+    // matching backwards from there gives the shortest window ending there
+    std::size_t begin = end;
+    for (std::size_t i = query.lengths.size(), offset = query.text.size(); i-- > 0;) {
+        offset -= query.lengths[i];
+        begin = key.rfind(char_at(offset, query.lengths[i]), begin - query.lengths[i]);
+    }
+    // score the leftmost match within the window
+    int score = 0;
+    std::size_t pos = begin, prev_end = std::string_view::npos;
+    for (std::size_t i = 0, offset = 0; i < query.lengths.size(); offset += query.lengths[i++]) {
+        pos = key.find(char_at(offset, query.lengths[i]), pos);
+        auto bonus = BONUS_SCORES[std::uint8_t(row.bonus[pos])];
+        if (i == 0) {
+            bonus *= BONUS_FIRST_CHAR_MULTIPLIER;
+        } else if (pos == prev_end) {
+            bonus += BONUS_CONSECUTIVE;
+        } else {
+            score += SCORE_GAP_START + SCORE_GAP_EXTENSION * int(pos - prev_end - 1);
+        }
+        score += SCORE_MATCH + bonus;
+        pos += query.lengths[i];
+        prev_end = pos;
+    }
+    return score;
+}
+
+SearchTable::Row SearchTable::make_row(GridBox* box, const Glib::ustring& name, const Glib::ustring& fields, Mask categories) const {
+    Row row{ {}, {}, 0, fold_search_key(fields, strip_diacritics), categories, box };
+    row.key = fold_search_key(name, strip_diacritics, &row.bonus);
+    row.chars = search_char_mask(row.key);
+    return row;
+}
+
+template <typename F>
+void SearchTable::for_each_trigram_(std::string_view fields, F && foo) {
+    std::vector<std::uint32_t> found;
+    for (std::size_t i = 0; i + 3 <= fields.size(); ++i) {
+        auto a = std::uint8_t(fields[i]), b = std::uint8_t(fields[i + 1]), c = std::uint8_t(fields[i + 2]);
+        // trigrams never span fields
+        if (a != '\n' && b != '\n' && c != '\n') {
+            found.push_back(a << 16 | b << 8 | c);
+        }
+    }
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    for (auto trigram: found) {
+        foo(trigram);
+    }
+}
+
+void SearchTable::index_row_(std::uint32_t row) {
+    for_each_trigram_(rows[row].fields, [this,row](auto trigram) {
+        auto && posting = trigrams[trigram];
+        // added rows are the last ones, so this is usually an append
+        posting.insert(std::upper_bound(posting.begin(), posting.end(), row), row);
+    });
+}
+
+void SearchTable::unindex_row_(std::uint32_t row) {
+    for_each_trigram_(rows[row].fields, [this,row](auto trigram) {
+        auto iter = trigrams.find(trigram);
+        auto && posting = iter->second;
+        posting.erase(std::lower_bound(posting.begin(), posting.end(), row));
+        if (posting.empty()) {
+            trigrams.erase(iter);
+        }
+    });
+}
+
+void SearchTable::move_row_(std::uint32_t from, std::uint32_t to) {
+    for_each_trigram_(rows[to].fields, [this,from,to](auto trigram) {
+        auto && posting = trigrams[trigram];
+        posting.erase(std::lower_bound(posting.begin(), posting.end(), from));
+        posting.insert(std::upper_bound(posting.begin(), posting.end(), to), to);
+    });
+}
+
+void SearchTable::add(GridBox& box, const Glib::ustring& name, const Glib::ustring& fields, Mask categories) {
+    positions[&box] = rows.size();
+    rows.push_back(make_row(&box, name, fields, categories));
+    index_row_(rows.size() - 1);
+}
+
+void SearchTable::erase(const GridBox& box) {
+    if (auto iter = positions.find(&box); iter != positions.end()) {
+        auto pos = iter->second;
+        positions.erase(iter);
+        unindex_row_(pos);
+        if (pos + 1 != rows.size()) {
+            rows[pos] = std::move(rows.back());
+            positions[rows[pos].box] = pos;
+            move_row_(rows.size() - 1, pos);
+        }
+        rows.pop_back();
+    }
+}
+
+void SearchTable::update(const GridBox& from, GridBox& to, const Glib::ustring& name, const Glib::ustring& fields, Mask categories) {
+    if (auto iter = positions.find(&from); iter != positions.end()) {
+        auto pos = iter->second;
+        positions.erase(iter);
+        unindex_row_(pos);
+        rows[pos] = make_row(&to, name, fields, categories);
+        positions[&to] = pos;
+        index_row_(pos);
+    } else {
+        add(to, name, fields, categories);
+    }
+}
+
+std::vector<std::uint32_t> SearchTable::lookup_fields(const SearchQuery& query) const {
+    std::vector<std::uint32_t> result;
+    if (query.text.size() < MIN_FIELDS_QUERY) {
+        return result;
+    }
+    std::vector<const std::vector<std::uint32_t>*> postings;
+    bool missing = false;
+    for_each_trigram_(query.text, [&](auto trigram) {
+        if (auto iter = trigrams.find(trigram); iter != trigrams.end()) {
+            postings.push_back(&iter->second);
+        } else {
+            missing = true;
+        }
+    });
+    if (missing || postings.empty()) {
+        return result;
+    }
+    // intersect starting from the shortest list, so the intermediate result only shrinks
+    std::sort(postings.begin(), postings.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+    result = *postings.front();
+    std::vector<std::uint32_t> next;
+    for (auto i = postings.begin() + 1; i != postings.end() && !result.empty(); ++i) {
+        next.clear();
+        std::set_intersection(result.begin(), result.end(), (*i)->begin(), (*i)->end(), std::back_inserter(next));
+        result.swap(next);
+    }
+    // trigrams may be scattered, check they are adjacent
+    result.erase(std::remove_if(result.begin(), result.end(), [&](auto row) {
+        return !matches_fields(rows[row], query);
+    }), result.end());
+    return result;
+}
+
+const SearchTable::Row* SearchTable::find(const GridBox& box) const {
+    if (auto iter = positions.find(&box); iter != positions.end()) {
+        return &rows[iter->second];
+    }
+    return nullptr;
+}
+
+const std::vector<std::uint32_t>* SearchCache::get(const std::string& key, std::uint64_t generation) {
+    auto iter = by_key.find(key);
+    if (iter == by_key.end() || iter->second->generation != generation) {
+        ++misses;
+        return nullptr;
+    }
+    ++hits;
+    results.splice(results.begin(), results, iter->second);
+    return &results.front().rows;
+}
+
+void SearchCache::put(std::string key, std::uint64_t generation, std::vector<std::uint32_t> rows) {
+    if (auto iter = by_key.find(key); iter != by_key.end()) {
+        auto && result = *iter->second;
+        result.generation = generation;
+        result.rows = std::move(rows);
+        results.splice(results.begin(), results, iter->second);
+        return;
+    }
+    if (results.size() == CAPACITY) {
+        by_key.erase(results.back().key);
+        results.pop_back();
+    }
+    auto && result = results.emplace_front(Result{ std::move(key), generation, std::move(rows) });
+    by_key.emplace(result.key, results.begin());
+}
@@ -0,0 +1,146 @@
+/* GTK-based application grid
+ * Copyright (c) 2021 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <glibmm/ustring.h>
+
+class GridBox;
+
+/* Bonus of a match starting at a key byte, see fold_search_key */
+enum SearchBonus: std::uint8_t {
+    NoBonus = 0,
+    CamelBonus,    // aB, a1
+    BoundaryBonus, // "a b", a-b, a_b
+    FirstBonus     // first character
+};
+
+/* Casefolds `str`, stripping combining marks (diacritics) if `strip_diacritics` is set.
+ * If `bonus` is not null, it receives SearchBonus of each byte of the result */
+std::string fold_search_key(const Glib::ustring& str, bool strip_diacritics, std::string* bonus = nullptr);
+
+// bit (b & 63) is set for each byte b of `str`
+inline std::uint64_t search_char_mask(std::string_view str) {
+    std::uint64_t mask = 0;
+    for (unsigned char c: str) {
+        mask |= std::uint64_t(1) << (c & 63);
+    }
+    return mask;
+}
+
+/* Folded query split into characters */
+struct SearchQuery {
+    std::string               text;
+    std::uint64_t             mask{ 0 };
+    std::vector<std::uint8_t> lengths; // byte length of each UTF-8 character of text
+
+    SearchQuery() = default;
+    SearchQuery(std::string text);
+};
+
+/* Flat table of searchable app data, kept apart from the widgets so that
+ * filtering scans contiguous memory and never touches GTK objects.
+ * Rows are unordered; erasing moves the last row in place of the erased one. */
+struct SearchTable {
+    using Mask = std::uint64_t; // see DesktopEntry::categories
+
+    // shorter queries are not looked up in secondary fields, see lookup_fields
+    static constexpr std::size_t MIN_FIELDS_QUERY = 3;
+
+    struct Row {
+        std::string   key;        // folded name
+        std::string   bonus;      // SearchBonus of each byte of key
+        std::uint64_t chars;      // search_char_mask(key)
+        std::string   fields;     // folded secondary fields (generic name, keywords...), '\n'-separated
+        Mask          categories;
+        GridBox*      box;
+    };
+
+    std::vector<Row> rows;
+    bool             strip_diacritics;
+
+    SearchTable(bool strip_diacritics): strip_diacritics{ strip_diacritics } {}
+
+    void add(GridBox& box, const Glib::ustring& name, const Glib::ustring& fields, Mask categories);
+    void erase(const GridBox& box);
+    // makes the row of `from` refer to `to`, adds a row if there is none
+    void update(const GridBox& from, GridBox& to, const Glib::ustring& name, const Glib::ustring& fields, Mask categories);
+    const Row* find(const GridBox& box) const;
+    // folds searchable data of `box`, which may be null for data not added to the table
+    Row make_row(GridBox* box, const Glib::ustring& name, const Glib::ustring& fields, Mask categories) const;
+    std::string fold(const Glib::ustring& str) const {
+        return fold_search_key(str, strip_diacritics);
+    }
+    /* Whether the characters of `query` appear in the key in order, not necessarily adjacent.
+     * Rows lacking any byte of the query are rejected by the masks without scanning the key */
+    static bool matches_name(const Row& row, const SearchQuery& query);
+    // whether secondary fields contain `query`, which must be at least MIN_FIELDS_QUERY long
+    static bool matches_fields(const Row& row, const SearchQuery& query) {
+        return query.text.size() >= MIN_FIELDS_QUERY && row.fields.find(query.text) != std::string::npos;
+    }
+    static bool matches(const Row& row, const SearchQuery& query) {
+        return matches_name(row, query) || matches_fields(row, query);
+    }
+    /* Scores a matching row, the higher the better: each matched character of the name counts,
+     * with bonuses for word starts, camelCase humps, the key start and adjacent matches,
+     * and penalties for gaps in between; matches in secondary fields only score less */
+    static int score(const Row& row, const SearchQuery& query);
+    /* Returns rows whose secondary fields contain `query`, in no particular order.
+     * Candidates are the intersection of the posting lists of the query trigrams,
+     * so only rows sharing all of them are scanned */
+    std::vector<std::uint32_t> lookup_fields(const SearchQuery& query) const;
+private:
+    std::unordered_map<const GridBox*, std::size_t> positions; // box -> index in rows
+    // trigram of secondary fields -> rows containing it, sorted
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> trigrams;
+    // calls foo(trigram) for each distinct trigram of `fields`
+    template <typename F>
+    static void for_each_trigram_(std::string_view fields, F && foo);
+    void index_row_(std::uint32_t row);
+    void unindex_row_(std::uint32_t row);
+    // updates posting lists after the row moved from `from` to `to`
+    void move_row_(std::uint32_t from, std::uint32_t to);
+};
+
+/* Bounded LRU cache of query -> matching rows of a SearchTable, in display order.
+ * Each result is tagged with the generation it was computed in,
+ * results of older generations are never returned. */
+class SearchCache {
+    static constexpr std::size_t CAPACITY = 64;
+
+    struct Result {
+        std::string                key;
+        std::uint64_t              generation;
+        std::vector<std::uint32_t> rows;
+    };
+    std::list<Result> results; // most recently used first
+    std::unordered_map<std::string_view, decltype(results)::iterator> by_key;
+public:
+    std::size_t hits{ 0 };
+    std::size_t misses{ 0 };
+
+    // returns cached rows for `key` or nullptr
+    const std::vector<std::uint32_t>* get(const std::string& key, std::uint64_t generation);
+    void put(std::string key, std::uint64_t generation, std::vector<std::uint32_t> rows);
+    // calls foo(key, rows) for each result of `generation`, which may update the rows
+    template <typename F>
+    void for_each(std::uint64_t generation, F && foo) {
+        for (auto && result: results) {
+            if (result.generation == generation) {
+                foo(result.key, result.rows);
+            }
+        }
+    }
+};
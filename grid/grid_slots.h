@@ -0,0 +1,111 @@
+/* GTK-based application grid
+ * Copyright (c) 2021 Piotr Miller
+ * e-mail: nwg.piotr@gmail.com
+ * Website: http://nwg.pl
+ * Project: https://github.com/nwg-piotr/nwg-launchers
+ * License: GPL3
+ * */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/* Stores objects of type T in fixed-size chunks of slots.
+ * Objects never move, so they may be referenced by pointer (e.g. by GTK),
+ * and are addressed by handles which become stale once the object is erased.
+ * Slots of erased objects are reused. */
+template <typename T>
+class SlotStorage {
+    static constexpr std::uint32_t CHUNK_SIZE = 64;
+
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        std::uint32_t generation{ 0 };
+        bool          alive{ false };
+
+        T* get() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    std::vector<std::uint32_t>           free_slots;
+    std::uint32_t                        used{ 0 };  // slots handed out at least once
+    std::size_t                          count{ 0 }; // alive objects
+
+    Slot& slot_(std::uint32_t index) {
+        return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+public:
+    struct Handle {
+        std::uint32_t index;
+        std::uint32_t generation;
+    };
+
+    SlotStorage() = default;
+    SlotStorage(const SlotStorage&) = delete;
+    ~SlotStorage() {
+        for (std::uint32_t i = 0; i < used; ++i) {
+            if (auto && slot = slot_(i); slot.alive) {
+                slot.get()->~T();
+            }
+        }
+    }
+
+    template <typename ... Args>
+    std::pair<Handle, T&> emplace(Args && ... args) {
+        std::uint32_t index;
+        if (!free_slots.empty()) {
+            index = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            if (used == chunks.size() * CHUNK_SIZE) {
+                chunks.emplace_back(new Slot[CHUNK_SIZE]);
+            }
+            index = used++;
+        }
+        auto && slot = slot_(index);
+        try {
+            new (slot.storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            free_slots.push_back(index);
+            throw;
+        }
+        slot.alive = true;
+        ++count;
+        return { Handle{ index, slot.generation }, *slot.get() };
+    }
+    // returns the object or nullptr if the handle is stale
+    T* get(Handle handle) {
+        if (handle.index < used) {
+            if (auto && slot = slot_(handle.index); slot.alive && slot.generation == handle.generation) {
+                return slot.get();
+            }
+        }
+        return nullptr;
+    }
+    void erase(Handle handle) {
+        if (get(handle)) {
+            auto && slot = slot_(handle.index);
+            slot.alive = false;
+            ++slot.generation;
+            --count;
+            free_slots.push_back(handle.index);
+            slot.get()->~T();
+        }
+    }
+    // calls foo(T&) for each alive object
+    template <typename F>
+    void for_each(F && foo) {
+        for (std::uint32_t i = 0; i < used; ++i) {
+            if (auto && slot = slot_(i); slot.alive) {
+                foo(*slot.get());
+            }
+        }
+    }
+    std::size_t size() const {
+        return count;
+    }
+};
@@ -6,6 +6,8 @@
  * License: GPL3
  * */
 
+#include <cmath>
+#include <ctime>
 #include <string_view>
 #include <variant>
 #include <fstream>
@@ -15,7 +17,27 @@
 #include "grid.h"
 #include "log.h"
 
-CacheEntry::CacheEntry(std::string desktop_id, int clicks): desktop_id(std::move(desktop_id)), clicks(clicks) { }
+CacheEntry::CacheEntry(std::string desktop_id, int clicks, double rank, std::int64_t last_launch):
+    desktop_id(std::move(desktop_id)), clicks(clicks), rank(rank), last_launch(last_launch) { }
+
+// time it takes for a launch to lose half of its weight
+constexpr double FRECENCY_HALF_LIFE = 7 * 24 * 3600;
+
+/*
+ * Frecency score decays exponentially: score(t) = score(t0) * 2^(-(t - t0) / half_life);
+ * log2(score(t)) + t / half_life is then the same at any t, so it's used as the rank:
+ * ranks of entries can be compared without decaying all of them to the current time
+ * */
+double frecency_rank(double score, std::int64_t time) {
+    return std::log2(score) + time / FRECENCY_HALF_LIFE;
+}
+
+/*
+ * Returns the score `rank` corresponds to at `time`
+ * */
+double frecency_score(double rank, std::int64_t time) {
+    return std::exp2(rank - time / FRECENCY_HALF_LIFE);
+}
 
 /*
  * Returns locations of .desktop files
@@ -84,21 +106,70 @@ std::vector<std::string> get_pinned(const fs::path& pinned_file) {
 }
 
 /*
- * Returns n cache items sorted by clicks; n should be the number of grid columns
+ * Returns cache items sorted by frecency rank, the best first.
+ * Items are either {"clicks": n, "score": s, "last": unix time} or plain click counts
+ * saved by older versions, which are treated as if launched just now
  * */
-std::vector<CacheEntry> get_favourites(ns::json&& cache, int number) {
-    // read from json object
+std::vector<CacheEntry> get_favourites(ns::json&& cache) {
+    std::int64_t now = std::time(nullptr);
     std::vector<CacheEntry> sorted_cache {}; // not yet sorted
-    for (auto it : cache.items()) {
-        sorted_cache.emplace_back(it.key(), it.value());
+    for (auto && [id, item] : cache.items()) {
+        try {
+            int          clicks;
+            double       score;
+            std::int64_t last;
+            if (item.is_number()) {
+                clicks = item.get<int>();
+                score = clicks;
+                last = now;
+            } else {
+                clicks = item.at("clicks").get<int>();
+                score = item.at("score").get<double>();
+                last = item.at("last").get<std::int64_t>();
+            }
+            // log2 of a non-positive score is -inf or NaN, which would break ordering by rank
+            auto rank = frecency_rank(score, last);
+            if (!(score > 0) || last <= 0 || !std::isfinite(rank)) {
+                Log::error("Invalid cache entry '", id, "': score ", score, ", last launch ", last);
+                continue;
+            }
+            sorted_cache.emplace_back(id, clicks, rank, last);
+        } catch (const ns::json::exception& e) {
+            Log::error("Invalid cache entry '", id, "': ", e.what());
+        }
     }
-    // actually sort by the number of clicks
     std::sort(sorted_cache.begin(), sorted_cache.end(), [](const CacheEntry& lhs, const CacheEntry& rhs) {
-        return lhs.clicks > rhs.clicks;
+        return lhs.rank > rhs.rank;
     });
-    // Trim to the number of columns, as we need just 1 row of favourites
-    auto from = sorted_cache.begin() + number;
-    auto to = sorted_cache.end();
-    sorted_cache.erase(from, to);
     return sorted_cache;
 }
+
+/*
+ * Returns stats of pinned & launched entries by their desktop ids
+ * */
+StatsIndex index_stats(Span<std::string> pins, Span<CacheEntry> favs, std::size_t n_favs) {
+    StatsIndex index;
+    index.reserve(pins.size() + favs.size());
+    for (std::size_t i = 0; i < pins.size(); ++i) {
+        // the first occurrence wins
+        if (auto && stats = index[pins[i]]; !stats.pinned) {
+            stats.pinned = Stats::Pinned;
+            // temporary fix for #176
+            // see comments to PinnedBoxes class
+            stats.position = i - pins.size() - 1;
+        }
+    }
+    // favs are sorted, the first n_favs unpinned ones are shown as favourites
+    std::size_t n_shown = 0;
+    for (auto && fav: favs) {
+        auto && stats = index[fav.desktop_id];
+        stats.clicks = fav.clicks;
+        stats.rank = fav.rank;
+        stats.last_launch = fav.last_launch;
+        if (!stats.pinned && n_shown < n_favs && fav.rank > -std::numeric_limits<double>::infinity()) {
+            stats.favorite = Stats::Favorite;
+            ++n_shown;
+        }
+    }
+    return index;
+}
@@ -3,9 +3,14 @@
 #ifndef ON_DESKTOP_ENTRY_H
 #define ON_DESKTOP_ENTRY_H
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <bitset>
-#include <iostream>
-#include <fstream>
+#include <cerrno>
+#include <cstring>
 #include <string>
 #include <string_view>
 #include "nwg_classes.h"
@@ -14,179 +19,374 @@
 
 #include "grid_entries.h"
 
-namespace entry_parse {
-    struct Error{};
-    struct Hidden{};
-}
+/* Parsing reports its outcome instead of throwing: hidden & broken files are common,
+ * and skipping them should cost no more than reading them */
+using ParseStatus = DesktopIndex::State;
 
-struct FieldParser {
-    virtual ~FieldParser() = default;
-    virtual void parse(std::string_view) = 0;
-};
+// starts a [Desktop Action id] section
+inline constexpr std::string_view action_header{ "[Desktop Action " };
 
-struct PlainFieldParser: public FieldParser {
-    std::string& dest;
+/* Contents of the whole file, read at once; `ok` is false if it could not be read.
+ * The files are small, and a copy stays valid if the file is truncated while being parsed */
+struct FileContents {
+    std::string_view data;
+    bool             ok{ false };
 
-    PlainFieldParser(std::string& dest): dest{ dest } {
-        // intentionally left blank
+    FileContents(const fs::path& path): FileContents{ AT_FDCWD, path.c_str() } {}
+    // opens `name` relative to the directory `dir_fd`
+    FileContents(int dir_fd, const char* name) {
+        int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return;
+        }
+        // the size is only a hint, the file may change meanwhile
+        buffer.resize(std::max<std::size_t>(st.st_size, 1) + 1);
+        std::size_t size = 0;
+        while (true) {
+            auto n = read(fd, buffer.data() + size, buffer.size() - size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                close(fd);
+                return;
+            }
+            if (n == 0) {
+                break;
+            }
+            size += n;
+            if (size == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+        }
+        close(fd);
+        buffer.resize(size);
+        data = buffer;
+        ok = true;
     }
-    virtual ~PlainFieldParser() = default;
-    virtual void parse(std::string_view str) override {
-        dest = str;
+    FileContents(const FileContents&) = delete;
+    // returns the next line of `rest` without the trailing '\n', advancing `rest` past it
+    static std::string_view next_line(std::string_view& rest) {
+        auto* eol = static_cast<const char*>(std::memchr(rest.data(), '\n', rest.size()));
+        auto len = eol ? std::size_t(eol - rest.data()) : rest.size();
+        auto line = rest.substr(0, len);
+        rest.remove_prefix(eol ? len + 1 : len);
+        return line;
     }
+private:
+    std::string buffer;
 };
 
-struct ExecParser: public PlainFieldParser {
-    using PlainFieldParser::PlainFieldParser;
-    void parse(std::string_view str) override {
-        std::string_view home{ "~/" };
-        if (str.substr(0, home.size()) == home) {
-            str.remove_prefix(home.size());
-            dest += get_home_dir();
-            dest.push_back('/');
-        }
+inline void parse_exec(std::string_view str, std::string& dest) {
+    std::string_view home{ "~/" };
+    if (str.substr(0, home.size()) == home) {
+        str.remove_prefix(home.size());
+        dest += get_home_dir();
+        dest.push_back('/');
+    }
+
+    auto idx = str.find(" %");
+    if (idx == std::string_view::npos) {
+        idx = std::size(str);
+    }
+    dest += str.substr(0, idx);
+}
 
-        auto idx = str.find(" %");
-        if (idx == std::string_view::npos) {
-            idx = std::size(str);
+inline void parse_categories(std::string_view str, decltype(DesktopEntry{}.categories)& categories, const DesktopEntryConfig& config) {
+    auto && ids = config.category_ids;
+    while (!str.empty()) {
+        auto end = str.find(';');
+        auto part = str.substr(0, end);
+        if (auto iter = ids.find(part); iter != ids.end()) {
+            categories |= decltype(DesktopEntry{}.categories)(1) << iter->second;
         }
-        dest += str.substr(0, idx);
+        str.remove_prefix(end == std::string_view::npos ? str.size() : end + 1);
     }
+}
+
+/* Keys of [Desktop Entry] & [Desktop Action] groups the parser cares about */
+enum class EntryKey: unsigned char {
+    Name = 0,
+    GenericName,
+    Keywords,
+    Exec,
+    Icon,
+    Comment,
+    Categories,
+    Terminal,
+    NoDisplay,
+    TryExec,
+    OnlyShowIn,
+    NotShowIn,
+    Unknown
 };
+constexpr std::size_t ENTRY_KEYS = std::size_t(EntryKey::Unknown);
+
+/* Maps key name to EntryKey; switching on the length leaves at most three comparisons */
+constexpr EntryKey entry_key(std::string_view key) {
+    using namespace std::literals::string_view_literals;
+    switch (key.size()) {
+        case 4:
+            if (key == "Name"sv) return EntryKey::Name;
+            if (key == "Exec"sv) return EntryKey::Exec;
+            if (key == "Icon"sv) return EntryKey::Icon;
+            break;
+        case 7:
+            if (key == "Comment"sv) return EntryKey::Comment;
+            if (key == "TryExec"sv) return EntryKey::TryExec;
+            break;
+        case 8:
+            if (key == "Keywords"sv) return EntryKey::Keywords;
+            if (key == "Terminal"sv) return EntryKey::Terminal;
+            break;
+        case 9:
+            if (key == "NoDisplay"sv) return EntryKey::NoDisplay;
+            if (key == "NotShowIn"sv) return EntryKey::NotShowIn;
+            break;
+        case 10:
+            if (key == "Categories"sv) return EntryKey::Categories;
+            if (key == "OnlyShowIn"sv) return EntryKey::OnlyShowIn;
+            break;
+        case 11:
+            if (key == "GenericName"sv) return EntryKey::GenericName;
+            break;
+    }
+    return EntryKey::Unknown;
+}
+
+// keys having Key[ln]= variants
+constexpr bool is_localized(EntryKey key) {
+    return key == EntryKey::Name || key == EntryKey::GenericName
+        || key == EntryKey::Keywords || key == EntryKey::Comment;
+}
 
-struct CategoryParser: public FieldParser {
-    using CategoriesType = decltype(DesktopEntry{}.categories);
-    CategoriesType& categories;
-    const ns::json& source;
-    const std::vector<std::string_view>& known_categories;
-
-    CategoryParser(CategoriesType& categories, const DesktopEntryConfig& config):
-        categories{ categories },
-        source{ config.config_source },
-        known_categories{ config.known_categories }
-    {
-        // intentionally left blank
-    }
-
-    void parse(std::string_view str) override {
-        auto is_known_category = [&](auto && c){
-            return std::find(known_categories.begin(), known_categories.end(), c) != known_categories.end();
-        };
-        auto parts = split_string(str, ";");
-        for (auto && part: parts) {
-            if (!part.empty() && is_known_category(part)) {
-                categories.emplace_back(category::localize(source, part));
+/* Values of the known keys of one group, as views into the file contents.
+ * The first occurrence of a key wins; localized values are only kept for config.lang */
+struct EntryValues {
+    std::string_view           values[ENTRY_KEYS];
+    std::string_view           localized[ENTRY_KEYS];
+    std::bitset<ENTRY_KEYS>    parsed;
+    std::bitset<ENTRY_KEYS>    parsed_localized;
+
+    // stores the value of `line`; returns the key or EntryKey::Unknown if the line is ignored
+    EntryKey add(std::string_view line, std::string_view lang) {
+        auto eq = line.find('=');
+        if (eq == std::string_view::npos) {
+            return EntryKey::Unknown;
+        }
+        auto key = line.substr(0, eq);
+        auto value = line.substr(eq + 1);
+        // spaces around '=' are ignored
+        while (!key.empty() && key.back() == ' ') {
+            key.remove_suffix(1);
+        }
+        while (!value.empty() && value.front() == ' ') {
+            value.remove_prefix(1);
+        }
+        std::string_view locale;
+        if (auto bracket = key.find('['); bracket != std::string_view::npos && key.back() == ']') {
+            locale = key.substr(bracket + 1, key.size() - bracket - 2);
+            key = key.substr(0, bracket);
+        }
+        auto id = entry_key(key);
+        if (id == EntryKey::Unknown) {
+            return id;
+        }
+        auto i = std::size_t(id);
+        if (locale.empty()) {
+            if (!parsed[i]) {
+                parsed.set(i);
+                values[i] = value;
+            }
+        } else if (is_localized(id) && locale == lang) {
+            if (!parsed_localized[i]) {
+                parsed_localized.set(i);
+                localized[i] = value;
             }
+        } else {
+            return EntryKey::Unknown;
         }
+        return id;
+    }
+    // the localized value if present, the plain one otherwise
+    std::string_view get(EntryKey key) const {
+        auto i = std::size_t(key);
+        return parsed_localized[i] ? localized[i] : values[i];
     }
 };
 
+// whether ';'-separated `list` contains any of `desktops`
+inline bool lists_desktop(std::string_view list, const std::vector<std::string>& desktops) {
+    while (!list.empty()) {
+        auto end = list.find(';');
+        auto part = list.substr(0, end);
+        for (auto && desktop: desktops) {
+            if (part == desktop) {
+                return true;
+            }
+        }
+        list.remove_prefix(end == std::string_view::npos ? list.size() : end + 1);
+    }
+    return false;
+}
+
+/*
+ * Checks TryExec of `entry`: whether the program exists & is executable;
+ * lookups are cached, so each program is checked once for all entries
+ * */
+inline bool can_try_exec(const DesktopEntry& entry, ExecutableCache& executables) {
+    return entry.try_exec.empty() || executables.find(entry.try_exec);
+}
+
 /*
- * Parses .desktop file to DesktopEntry struct,
- * throwing entry_parse::{Error,Hidden} or io errors
+ * Parses .desktop file to `entry`, which is only filled if the result is Ok
+ * Fields are scanned as views into the file contents and copied only once they are known to be kept,
+ * so nothing is allocated for hidden & invalid files
 * */
-DesktopEntry parse_desktop_entry(const fs::path& path, const DesktopEntryConfig& config) {
+ParseStatus parse_desktop_entry(const FileContents& file, const DesktopEntryConfig& config, DesktopEntry& entry) {
     using namespace std::literals::string_view_literals;
 
-    DesktopEntry entry;
-    entry.terminal = false;
-
-    std::ifstream file{ path };
-    if (!file) {
-        throw entry_parse::Error{};
-    }
-    std::string str; // buffer to read into
-
-    std::string name_ln {};    // localized: Name[ln]=
-    std::string comment_ln {}; // localized: Comment[ln]=
-
-    // if line starts with `prefix`, call `parser.parse()`
-    struct Match {
-        std::string_view prefix;
-        FieldParser&     parser;
-    };
-    struct Result {
-        bool   ok;
-        size_t pos;
-    };
-    PlainFieldParser name_parser{ entry.name };
-    PlainFieldParser name_ln_parser{ name_ln };
-    ExecParser exec_parser{ entry.exec };
-    PlainFieldParser icon_parser{ entry.icon };
-    PlainFieldParser comment_parser{ entry.comment };
-    PlainFieldParser comment_ln_parser{ comment_ln };
-    PlainFieldParser mime_type_parser{ entry.mime_type };
-    CategoryParser categories_parser{ entry.categories, config };
-
-    Match matches[] = {
-        { "Name="sv,         name_parser },
-        { config.name_ln,    name_ln_parser },
-        { "Exec="sv,         exec_parser },
-        { "Icon="sv,         icon_parser },
-        { "Comment="sv,      comment_parser },
-        { config.comment_ln, comment_ln_parser },
-        { "MimeType="sv,     mime_type_parser },
-        { "Categories="sv,   categories_parser }
-    };
-    std::bitset<std::size(matches)> parsed;
+    if (!file.ok) {
+        return DesktopIndex::Invalid;
+    }
+    auto rest = file.data;
 
     // Skip everything not related
     constexpr auto header = "[Desktop Entry]"sv;
-    while (std::getline(file, str)) {
-        str.resize(header.size());
-        if (str == header) {
+    while (!rest.empty()) {
+        auto line = FileContents::next_line(rest);
+        if (line.substr(0, header.size()) == header) {
             break;
         }
     }
-    // Repeat until the next section
-    constexpr auto nodisplay = "NoDisplay=true"sv;
-    constexpr auto terminal = "Terminal=true"sv;
-    while (std::getline(file, str) && !parsed.all()) {
-        if (!str.empty() && str[0] == '[') { // new section begins, break
+    // Repeat until the next section; any key may come last, so the whole group is read
+    EntryValues values;
+    while (!rest.empty()) {
+        auto line_start = rest;
+        auto view = FileContents::next_line(rest);
+        if (!view.empty() && view[0] == '[') { // new section begins, break
+            rest = line_start;
             break;
         }
-        auto view = std::string_view{str};
-        auto view_len = std::size(view);
-        if (view == nodisplay) {
-            throw entry_parse::Hidden{};
-        }
-        if (view == terminal) {
-            entry.terminal = true;
-        }
-        auto try_strip_prefix = [&view, view_len](auto& prefix) {
-            auto len = std::min(view_len, std::size(prefix));
-            return Result {
-                prefix == view.substr(0, len),
-                len
-            };
-        };
-        std::size_t index{ 0 };
-        for (auto& [prefix, parser] : matches) {
-            if (parsed[index]) {
-                continue;
-            }
-            if (auto [ok, pos] = try_strip_prefix(prefix); ok) {
-                parser.parse(view.substr(pos));
+        switch (values.add(view, config.lang)) {
+            case EntryKey::NoDisplay:
+                if (values.get(EntryKey::NoDisplay) == "true"sv) {
+                    return DesktopIndex::Hidden;
+                }
                 break;
-            }
-            ++index;
+            case EntryKey::Unknown:
+                continue;
+            default: break;
         }
     }
 
-    if (!name_ln.empty()) {
-        entry.name = std::move(name_ln);
+    // entries meant for other desktops are hidden
+    auto && desktops = config.current_desktops;
+    if (values.parsed[std::size_t(EntryKey::OnlyShowIn)] && !lists_desktop(values.get(EntryKey::OnlyShowIn), desktops)) {
+        return DesktopIndex::Hidden;
     }
-    if (!comment_ln.empty()) {
-        entry.comment = std::move(comment_ln);
+    if (lists_desktop(values.get(EntryKey::NotShowIn), desktops)) {
+        return DesktopIndex::Hidden;
     }
-    if (entry.name.empty() || entry.exec.empty()) {
-        throw entry_parse::Error{};
+
+    auto name = values.get(EntryKey::Name);
+    auto exec = values.get(EntryKey::Exec);
+    if (name.empty() || exec.empty()) {
+        return DesktopIndex::Invalid;
     }
+    entry.terminal = values.get(EntryKey::Terminal) == "true"sv;
+    // checked apart from parsing, see can_try_exec: the program may be installed later
+    entry.try_exec = values.get(EntryKey::TryExec);
+    entry.name = name;
+    entry.generic_name = values.get(EntryKey::GenericName);
+    entry.keywords = values.get(EntryKey::Keywords);
     if (entry.terminal) {
-        entry.exec = concat(config.term, " ", entry.exec);
+        entry.exec = concat(config.term, " ");
+    }
+    parse_exec(exec, entry.exec);
+    entry.icon = values.get(EntryKey::Icon);
+    entry.comment = values.get(EntryKey::Comment);
+    parse_categories(values.get(EntryKey::Categories), entry.categories, config);
+
+    // only remember where actions are, jumping from section to section
+    auto && data = file.data;
+    for (std::size_t pos = rest.data() - data.data(); pos < data.size();) {
+        if (data.substr(pos, action_header.size()) == action_header) {
+            entry.actions.push_back(pos);
+        }
+        auto next = data.find("\n["sv, pos);
+        if (next == std::string_view::npos) {
+            break;
+        }
+        pos = next + 1;
     }
 
-    return entry;
+    return DesktopIndex::Ok;
+}
+
+// parses .desktop file `name` in the directory `dir_fd`, see above
+ParseStatus parse_desktop_entry(int dir_fd, const char* name, const DesktopEntryConfig& config, DesktopEntry& entry) {
+    return parse_desktop_entry(FileContents{ dir_fd, name }, config, entry);
+}
+ParseStatus parse_desktop_entry(const fs::path& path, const DesktopEntryConfig& config, DesktopEntry& entry) {
+    return parse_desktop_entry(AT_FDCWD, path.c_str(), config, entry);
+}
+
+struct DesktopAction {
+    std::string  id; // action identifier, as in [Desktop Action id]
+    DesktopEntry entry;
+};
+
+/*
+ * Parses [Desktop Action] section of `parent` starting at `offset` in `data`, the contents
+ * of its .desktop file, to `action`, returning false if it is invalid;
+ * the action inherits icon & categories from `parent`
+ * */
+bool parse_desktop_action(std::string_view data, std::uint32_t offset, const DesktopEntry& parent, const DesktopEntryConfig& config, DesktopAction& action) {
+    if (offset >= data.size()) {
+        return false;
+    }
+    auto rest = data.substr(offset);
+    auto header = FileContents::next_line(rest);
+    // the file might have changed since offsets were taken
+    if (header.substr(0, action_header.size()) != action_header || header.back() != ']') {
+        return false;
+    }
+    header.remove_prefix(action_header.size());
+    header.remove_suffix(1);
+
+    EntryValues values;
+    while (!rest.empty()) {
+        auto view = FileContents::next_line(rest);
+        if (!view.empty() && view[0] == '[') {
+            break;
+        }
+        values.add(view, config.lang);
+    }
+    auto name = values.get(EntryKey::Name);
+    auto exec = values.get(EntryKey::Exec);
+    auto icon = values.get(EntryKey::Icon);
+    if (name.empty() || exec.empty()) {
+        return false;
+    }
+    action.id = header;
+    auto && entry = action.entry;
+    entry.name = name;
+    // shown as description, so that it's clear which app the action belongs to
+    entry.comment = parent.name;
+    entry.terminal = parent.terminal;
+    if (entry.terminal) {
+        entry.exec = concat(config.term, " ");
+    }
+    parse_exec(exec, entry.exec);
+    entry.icon = icon.empty() ? parent.icon : icon;
+    entry.categories = parent.categories;
+    return true;
 }
 
 #endif